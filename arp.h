@@ -3,14 +3,19 @@
 #include "daisy_pod.h"
 #include "daisysp.h"
 
-#include <random>
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include <functional>
+#include <numeric>
+#include <vector>
 
 #include "note.h"
 #include "player.h"
+#include "rng.h"
 
 //#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
-#define LogPrint(...) 
+#define LogPrint(...)
 
 enum class ArpMode{
   asis,
@@ -18,40 +23,111 @@ enum class ArpMode{
   desc,
   pingpong,
   random,
+  updown_incl, // 1 2 3 3 2 1
+  updown_excl, // 1 2 3 2
   Count
 };
 
+// One tick of the arp, see Arp::build
+struct ArpStep {
+  static constexpr uint8_t rest{127};   // cuts the sound, from the step notes
+  static constexpr uint8_t off{0xFE};   // euclidean gap, lets it ring
+  static constexpr uint8_t random{0xFF}; // pick a note when it's played
+  uint8_t note;
+  uint8_t ratchet; // triggers in the tick, 1 - 4
+};
+
+// The notes, mode, octave range, euclidean gates and ratchets are all
+// worked out into one table whenever any of them changes, playing it is
+// one table step a tick.
 class Arp {
+  public:
+  static constexpr size_t max_table{256};
+  static constexpr size_t max_notes{8}; // as many as a step holds
+  // Ticks are split up for ratchets, 12 fits 1, 2, 3 and 4 evenly
+  static constexpr uint8_t sub_div{12};
+
+  private:
   daisysp::Metro tick{};
   bool next{false};
-  uint8_t arp_select{0};
-  int pingpong_dir = 1;
+  bool first{false}; // next is for the start of a tick, not a ratchet
   ArpMode mode{ArpMode::asis};
-  std::mt19937 rng;
+  uint8_t skip{0}; // percent chance a note is left out
+  bool skipping{false};
+
+  uint8_t octaves{1};
+  uint8_t euclid_steps{1};
+  uint8_t euclid_hits{1};
+  uint8_t euclid_rotate{0};
+  uint8_t ratchet{1};
+  uint8_t ratchet_every{1}; // every nth note that plays
 
   std::vector<uint8_t> notes;
-  std::vector<uint8_t> notes_asc;
-  std::vector<uint8_t> notes_desc;
-  uint8_t current_note;
+  std::array<ArpStep, max_table> table{};
+  size_t len{0};
+  size_t pos{0};
+  bool restart{true}; // the next tick plays from the top
+  uint8_t sub{0};
+  // What the start of the tick played, for its ratchets. Nothing plays
+  // until a tick has started, the arp may come in on a ratchet.
+  uint8_t current_note{ArpStep::rest};
+  bool have_note{false};
 
   public:
-  Arp(float samplerate) :
-  rng(0)
+  Arp(float samplerate)
   {
-    tick.Init(50.0, samplerate);
+    tick.Init(50.0 * sub_div, samplerate);
+  }
+
+  void set_skip(uint8_t percent) {
+    LogPrint("Control Received: Arp Skip -> %u\n", percent);
+    skip = percent;
   }
 
-  void set_note_len(float secs) { 
-    tick.SetFreq(1.0 / secs);
+  void set_note_len(float secs) {
+    tick.SetFreq(sub_div / secs);
+  }
+  ArpMode get_mode() { return mode; }
+  void set_mode(ArpMode m) {
+    mode = m;
+    build();
   }
   void next_mode() {
     int imode = static_cast<int>(mode) + 1;
     int icnt = static_cast<int>(ArpMode::Count);
-    if(imode >= icnt) 
+    if(imode >= icnt)
       imode = 0;
     mode = static_cast<ArpMode>(imode);
+    build();
    }
 
+  void set_octaves(uint8_t n) {
+    octaves = std::clamp<uint8_t>(n, 1, 4);
+    build();
+  }
+  // Hits spread as evenly as they go over the steps, 1 of 1 is every
+  // tick. Hits over steps is kept and works as all of them.
+  void set_euclid_steps(uint8_t n) {
+    euclid_steps = std::clamp<uint8_t>(n, 1, 32);
+    build();
+  }
+  void set_euclid_hits(uint8_t n) {
+    euclid_hits = std::clamp<uint8_t>(n, 1, 32);
+    build();
+  }
+  void set_euclid_rotate(uint8_t n) {
+    euclid_rotate = n;
+    build();
+  }
+  void set_ratchet(uint8_t count) {
+    ratchet = std::clamp<uint8_t>(count, 1, 4);
+    build();
+  }
+  void set_ratchet_every(uint8_t n) {
+    ratchet_every = std::max<uint8_t>(n, 1);
+    build();
+  }
+
   void mode_name(char name_out[9]) {
     std::memset(name_out, 0, 9);
     switch(mode) {
@@ -70,6 +146,12 @@ class Arp {
       case ArpMode::random:
         std::memcpy(name_out, "Rand", 5);
         break;
+      case ArpMode::updown_incl:
+        std::memcpy(name_out, "UpDn Inc", 8);
+        break;
+      case ArpMode::updown_excl:
+        std::memcpy(name_out, "UpDn Exc", 8);
+        break;
       default:
         break;
     }
@@ -77,36 +159,25 @@ class Arp {
 
   void clear() {
     notes.clear();
-    notes_asc.clear();
-    notes_desc.clear();
-    arp_select = 0;
+    pos = 0;
+    restart = true;
+    have_note = false;
+    build();
   }
 
   void set_notes(std::vector<uint8_t>& new_notes) {
     notes = new_notes;
-    // Set the sorted notes
-    notes_asc = notes;
-    std::sort(notes_asc.begin(), notes_asc.end(), std::less<uint8_t>());
-    notes_desc = notes;
-    std::sort(notes_desc.begin(), notes_desc.end(), std::greater<uint8_t>());
+    build();
   }
 
   void add_note(uint8_t note) {
     notes.push_back(note);
-    // Set the sorted notes
-    notes_asc = notes;
-    std::sort(notes_asc.begin(), notes_asc.end(), std::less<uint8_t>());
-    notes_desc = notes;
-    std::sort(notes_desc.begin(), notes_desc.end(), std::greater<uint8_t>());
+    build();
   }
 
-  void insert_note(uint8_t pos, uint8_t note) {
-    notes.push_back(note);
-    // Set the sorted notes
-    notes_asc = notes;
-    std::sort(notes_asc.begin(), notes_asc.end(), std::less<uint8_t>());
-    notes_desc = notes;
-    std::sort(notes_desc.begin(), notes_desc.end(), std::greater<uint8_t>());
+  void insert_note(uint8_t at, uint8_t note) {
+    notes.insert(notes.begin() + std::min<size_t>(at, notes.size()), note);
+    build();
   }
 
   void walk_notes(int dir) {
@@ -114,68 +185,151 @@ class Arp {
     notes.pop_back();
     n += 12 * dir;
     notes.insert(notes.begin(), n);
+    build();
   }
 
-  void update(Player& player) {
-    if(!next) return;
+  // Returns whether a tick was used up
+  bool update(Player& player) {
+    if(!next) return false;
     next = false;
-    
-    if(notes.size() <= 0) 
-      return;
 
-    switch(static_cast<int>(mode)) {
-      case static_cast<int>(ArpMode::asis): 
-        update_asis();
-        current_note = notes[arp_select];
-        break;
-      case static_cast<int>(ArpMode::asc): 
-        update_asis();
-        current_note = notes_asc[arp_select];
-        break;
-      case static_cast<int>(ArpMode::desc): 
-        update_asis();
-        current_note = notes_desc[arp_select];
-        break;
-      case static_cast<int>(ArpMode::pingpong): 
-        update_pingpong();
-        current_note = notes[arp_select];
-        break;
-      case static_cast<int>(ArpMode::random): 
-        update_random();
-        current_note = notes[arp_select];
-        break;
+    if(len == 0)
+      return true;
+    const ArpStep& step = table[pos];
+    if(step.note == ArpStep::off)
+      return true;
+
+    // Ratchets repeat whatever the start of the tick played
+    if(first) {
+      // The pattern moves on but the note isn't played
+      skipping = skip > 0 && rng.chance(skip);
+      current_note = step.note;
+      if(current_note == ArpStep::random)
+        current_note = pick_random();
+      have_note = true;
     }
+    if(skipping || !have_note)
+      return true;
 
-    if(current_note == 127)
-      player.play_rest();
+    if(current_note == ArpStep::rest) {
+      if(first)
+        player.play_rest();
+    }
     else {
       static daisy::NoteOnEvent note{0, current_note, 127};
       note.note = current_note;
       player.play_note(note);
     }
+    return true;
   }
 
-  void update_pingpong() {
-    if(arp_select >= notes.size() - 1) {
-      pingpong_dir = -1;
+  // AUDIO CALLBACK, once per block. The position in the table moves here
+  // so it stays in step with the audio, update() just plays what's due.
+  void process() {
+    if(!tick.Process())
+      return;
+    if(++sub >= sub_div) {
+      sub = 0;
+      if(len > 0)
+        pos = restart ? 0 : (pos + 1) % len;
+      restart = len == 0;
     }
-    if(arp_select <= 0) {
-      pingpong_dir = 1;
+    if(len == 0)
+      return;
+    uint8_t every = sub_div / table[pos].ratchet;
+    if(sub % every == 0) {
+      first = sub == 0;
+      next = true;
     }
-    arp_select = (arp_select + pingpong_dir) % notes.size();
   }
 
-  void update_random() {
-    std::uniform_int_distribution<> distrib(0, notes.size() - 1);
-    arp_select = distrib(rng);
+  private:
+  uint8_t pick_random() {
+    uint8_t n = notes[rng.below(notes.size())];
+    if(n == ArpStep::rest)
+      return n;
+    return std::min<int>(n + 12 * rng.below(octaves), 126);
   }
 
-  void update_asis() {
-    arp_select = (arp_select + 1) % notes.size();
+  // Main loop, always with the audio callback held off
+  void build() {
+    // The note order for one pass
+    std::array<uint8_t, max_notes * 4 * 2> order{};
+    size_t n = 0;
+    if(!notes.empty()) {
+      if(mode == ArpMode::random)
+        order[n++] = ArpStep::random;
+      else
+        n = build_order(order.data());
+    }
+    if(n == 0) {
+      len = 0;
+      pos = 0;
+      return;
+    }
+
+    // Walk the euclidean gates, the notes only move on at a hit. Stop
+    // when the gates, notes and ratchets all come back round together.
+    const size_t steps = euclid_steps;
+    const size_t hits = std::min(euclid_hits, euclid_steps);
+    const size_t rotate = euclid_rotate % steps;
+    size_t i = 0, played = 0;
+    len = 0;
+    while(len < max_table) {
+      bool hit = ((i + rotate) * hits) % steps < hits;
+      ArpStep& s = table[len++];
+      if(hit) {
+        s.note = order[played % n];
+        s.ratchet = ratchet > 1 && played % ratchet_every == 0 ? ratchet : 1;
+        played++;
+      }
+      else
+        s = {ArpStep::off, 1};
+      i++;
+      if(i % steps == 0 && played % n == 0 && played % ratchet_every == 0)
+        break;
+    }
+    pos %= len;
+    LogPrint("Arp::build %u notes -> %u steps\n", n, len);
   }
 
-  void process() {
-    if(!next) 
-      next = tick.Process();
+  size_t build_order(uint8_t* out) {
+    // Octaves stack up the notes, rests stay rests
+    std::array<uint8_t, max_notes * 4> base{};
+    size_t count = std::min<size_t>(notes.size(), max_notes);
+    std::array<uint8_t, max_notes> sorted{};
+    std::copy(notes.begin(), notes.begin() + count, sorted.begin());
+    const uint8_t* src = notes.data();
+    if(mode == ArpMode::asc || mode == ArpMode::updown_incl || mode == ArpMode::updown_excl) {
+      std::sort(sorted.begin(), sorted.begin() + count, std::less<uint8_t>());
+      src = sorted.data();
+    }
+    else if(mode == ArpMode::desc) {
+      std::sort(sorted.begin(), sorted.begin() + count, std::greater<uint8_t>());
+      src = sorted.data();
+    }
+    size_t m = 0;
+    for(uint8_t o = 0; o < octaves; o++)
+      for(size_t k = 0; k < count; k++)
+        base[m++] = src[k] == ArpStep::rest ? ArpStep::rest : std::min<int>(src[k] + 12 * o, 126);
+
+    size_t n = 0;
+    for(size_t k = 0; k < m; k++)
+      out[n++] = base[k];
+    switch(mode) {
+      case ArpMode::pingpong:
+      case ArpMode::updown_excl:
+        // Back down without repeating either end
+        for(size_t k = m - 1; k > 1; k--)
+          out[n++] = base[k - 1];
+        break;
+      case ArpMode::updown_incl:
+        for(size_t k = m; k > 0; k--)
+          out[n++] = base[k - 1];
+        break;
+      default:
+        break;
+    }
+    return n;
   }
 };
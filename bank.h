@@ -0,0 +1,74 @@
+#pragma once
+#include "daisy_pod.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include "controls.h"
+
+//#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+#define LogPrint(...)
+
+// Fixed size copies of Seq patterns so the whole bank can sit in SDRAM.
+// The Seq only keeps the playing pattern and the queued one as Steps.
+
+struct StoredStep {
+  uint8_t num_notes;
+  std::array<uint8_t, 8> notes;
+  uint8_t num_locks;
+  std::array<ParamLock, 4> locks;
+  uint8_t mode; // StepMode
+  uint16_t strum;
+  uint8_t probability;
+};
+
+struct StoredPattern {
+  uint8_t num_steps;
+  std::array<StoredStep, 32> steps;
+};
+
+class PatternBank {
+  public:
+  static constexpr size_t num_patterns{64};
+  static constexpr size_t max_steps{32};
+  static constexpr size_t max_notes{8};
+  static constexpr size_t max_locks{4};
+
+  private:
+  std::array<StoredPattern, num_patterns> patterns;
+
+  public:
+  // SDRAM isn't zeroed at boot so clear everything explicitly
+  PatternBank() {
+    for(auto& pattern : patterns)
+      clear(pattern);
+  }
+
+  void clear(StoredPattern& pattern) {
+    pattern.num_steps = 1;
+    for(auto& step : pattern.steps) {
+      step.num_notes = 0;
+      step.num_locks = 0;
+      step.mode = 0;
+      step.strum = 0;
+      step.probability = 100;
+    }
+  }
+
+  StoredPattern& pattern(uint8_t slot) { return patterns[slot % num_patterns]; }
+
+  // A pattern from outside (sysex), the counts are clamped so a bad dump
+  // can't run the Seq off the end of the arrays
+  void load(uint8_t slot, const StoredPattern& in) {
+    StoredPattern& p = pattern(slot);
+    p = in;
+    p.num_steps = std::clamp<uint8_t>(p.num_steps, 1, max_steps);
+    for(auto& step : p.steps) {
+      step.num_notes = std::min<uint8_t>(step.num_notes, max_notes);
+      step.num_locks = std::min<uint8_t>(step.num_locks, max_locks);
+    }
+  }
+};
+
+// Same trick as the reverb, the bank is too big for SRAM
+static uint32_t DSY_SDRAM_BSS bank_heap[sizeof(PatternBank) / sizeof(uint32_t) + 1];
@@ -0,0 +1,696 @@
+#pragma once
+#include "daisy_pod.h"
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+#include "arp.h"
+#include "bank.h"
+#include "controls.h"
+#include "governor.h"
+#include "lcd.h"
+#include "midi_in.h"
+#include "midi_out.h"
+#include "part.h"
+#include "player.h"
+#include "recorder.h"
+#include "sampler.h"
+#include "seq.h"
+#include "sysex.h"
+
+//#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+#define LogPrint(...)
+
+// MIDI, Pod controls and SysEx onto the parts. It's all main loop, and
+// in a header so the host replay (host/replay.cpp) can run a recorded
+// session back through it.
+
+/* Arturia Minilab mkII
+
+ click midi, turn midi
+   o
+ knob numbering   
+       
+ 113,112  74   71   76   77   93   73   75
+   O      o    o    o    o    o    o    o
+   1      2    3    4    5    6    7    8  
+
+ 115,114  ?    19   16   17   91   79   72
+   O      o    o    o    o    o    o    o
+   9     10   11   12   13   14   15   16
+
+ */
+
+// One pass worth of Pod hardware changes
+struct PodState {
+  static constexpr uint8_t encoder_rise{1 << 0};
+  static constexpr uint8_t button1_rise{1 << 1};
+  static constexpr uint8_t button2_rise{1 << 2};
+  static constexpr uint8_t button2_fall{1 << 3};
+  static constexpr uint8_t button2_held{1 << 4};
+  static constexpr uint8_t detune_moved{1 << 5};
+
+  uint8_t flags{0};
+  int32_t inc{0};
+  float detune{0};
+
+  bool idle() const { return inc == 0 && (flags & ~button2_held) == 0; }
+};
+
+class Controller {
+  // Map of daisy::ControlChangeEvent::control_number aka midi control number
+  // to the synth control.
+  // If you're hooking up your own controller, this is the place
+  // to map your controls.
+  std::unordered_map<uint8_t, SynthControl> midi_map {
+      {112, SynthControl::seq_step_add_del}, // Knob 1 turn (value 64 ignore, 63 down, 65 up)
+      {113, SynthControl::seq_pause_toggle}, // Knob 1 press
+      {114, SynthControl::delay_sync}, // Knob 9 turn (value 64 ignore, 63 down, 65 up)
+      {115, SynthControl::arp_mode}, // Knob 9 press, in edit mode the step mode
+
+      {74, SynthControl::wave_shape}, // Knob 2
+      {18, SynthControl::seq_step_length}, // Knob 10, in edit mode the step strum
+
+      {71, SynthControl::vcf_cutoff}, // Knob 3
+      {19, SynthControl::vcf_resonance}, // Knob 11
+
+      {76, SynthControl::vcf_envelope_depth}, // Knob 4
+      {16, SynthControl::arp_note_length}, // Knob 12
+                                           //
+      {77, SynthControl::delay_mix}, // Knob 5
+      {17, SynthControl::delay_time}, // Knob 13
+      {85, SynthControl::delay_damp}, // the rest are on undefined CCs, see the README
+
+      {1, SynthControl::lfo1_cutoff}, // Mod strip
+      {86, SynthControl::lfo1_rate},
+      {87, SynthControl::lfo2_rate},
+      {88, SynthControl::lfo2_pan},
+      {89, SynthControl::lfo1_shape}, // sine, tri, saw, square
+      {90, SynthControl::lfo2_shape},
+      {14, SynthControl::lfo1_delay_mix},
+      {15, SynthControl::lfo2_detune},
+      {102, SynthControl::tuning_scale},
+      {103, SynthControl::tuning_root}, // value is the root midi note
+      {104, SynthControl::transpose_mode}, // press, off / hold / latch / legato
+      {20, SynthControl::unison_voices}, // 1 to 8 saws
+      {21, SynthControl::unison_spread},
+      {22, SynthControl::drive},
+      {23, SynthControl::drive_oversample}, // 1x, 2x, 4x
+      {105, SynthControl::snapshot_a}, // press, stores the patch for the morph
+      {106, SynthControl::snapshot_b}, // press
+      {24, SynthControl::humanize_velocity},
+      {25, SynthControl::humanize_time},
+      {26, SynthControl::arp_skip},
+      {27, SynthControl::step_probability}, // edit mode, the current step
+      {28, SynthControl::arp_octaves},
+      {29, SynthControl::euclid_steps},
+      {30, SynthControl::euclid_hits},
+      {31, SynthControl::euclid_rotate},
+      {3, SynthControl::arp_ratchet},
+      {9, SynthControl::arp_ratchet_every}, // every nth note played
+      {107, SynthControl::midi_out_notes}, // on from 64, the part's notes to MIDI out
+      {108, SynthControl::midi_out_clock}, // on from 64
+      {109, SynthControl::midi_in_filter}, // all, TRS, USB, split
+      {110, SynthControl::sample_select}, // 0 is the oscillators, then 0.wav to 7.wav
+      {111, SynthControl::input_mode}, // audio in off / right / stereo
+      {116, SynthControl::input_gate}, // on from 64, the part's notes gate the input
+      
+      {91, SynthControl::reverb_feedback}, // Knob 6
+      {93, SynthControl::reverb_wet}, // Knob 14
+
+      {73, SynthControl::envelope_a_vca}, // Knob 7
+      {79, SynthControl::envelope_a_vcf}, // Knob 15
+
+      {75, SynthControl::envelope_d_vca}, // Knob 8
+      {72, SynthControl::envelope_d_vcf}, // Knob 16
+  };
+  daisy::Color red;
+  daisy::Color green;
+  daisy::Color blue;
+  float samplerate;
+  Part* parts;
+  Part* part; // the one the Pod edits, follows the last midi channel used
+  LCD& lcd;
+  daisy::DaisyPod& pod;
+  Recorder& recorder;
+  PatternBank& bank;
+  bool edit_mode = false;
+  uint8_t pattern_slot{0};
+  bool chaining{false};
+  
+  daisy::Parameter detune;
+  daisy::Parameter morph;
+
+  char lcd_top[17]{0,};
+  char lcd_bot[17]{0,};
+
+  // Dumps are unpacked into these, then copied in whole once complete
+  sysex::Decoder sysex_in;
+  StoredPattern sysex_pattern;
+  Patch sysex_patch;
+
+  public:
+  Controller(float samplerate, Part* parts, LCD& lcd, daisy::DaisyPod& pod, Recorder& recorder, PatternBank& bank)
+    : samplerate(samplerate)
+    , parts(parts)
+    , part(&parts[0])
+    , lcd(lcd)
+     ,pod(pod)
+    , recorder(recorder)
+    , bank(bank)  {
+    sysex_in.set_pattern_dest(reinterpret_cast<uint8_t*>(&sysex_pattern), sizeof(sysex_pattern));
+    sysex_in.set_patch_dest(sysex_patch.values.data(), sysex_patch.values.size());
+    red.Init(1, 0, 0);
+    green.Init(0, 1, 0);
+    blue.Init(0, 1, 0);
+    detune.Init(pod.knob1, 1., 2., daisy::Parameter::LINEAR);
+    morph.Init(pod.knob2, 0., 1., daisy::Parameter::LINEAR);
+    //p_inversion.Init(hw.knob2, 0, 5, Parameter::LINEAR);
+  }
+
+  void redraw() {    
+    Seq& seq = part->seq;
+    lcd.clear();
+    lcd.setCursor(0,0);
+    static std::string tmp{""};
+    if(edit_mode) {
+      tmp.clear();
+      for(uint8_t note : seq.get_step().notes) {
+        if(note < 10)
+          tmp.push_back('0' + note);
+        else
+          tmp.push_back('A' + note - 10);
+      }
+      lcd.print(tmp);
+      tmp.clear();
+      // Mode and strum in ms on the right
+      const Step& step = seq.get_step();
+      char mode[8]{0,};
+      if(step.mode == StepMode::chord && step.strum > 0)
+        std::sprintf(mode, "%s%3i", step_mode_names[static_cast<size_t>(step.mode)],
+            static_cast<int>(1000 * step.strum / samplerate));
+      else
+        std::sprintf(mode, "%s", step_mode_names[static_cast<size_t>(step.mode)]);
+      lcd.setCursor(LCD::cols - 6, 0);
+      lcd.print(mode);
+
+      lcd.setCursor(0, 1);
+      for(int i = 0; i < seq.get_num_steps(); i++)
+        if(i == seq.get_step_num())
+            lcd.print("^");
+        else
+            lcd.print("-");
+    }
+    else {
+      lcd.print(lcd_top);
+      lcd.setCursor(0,1);
+      lcd.print(lcd_bot);
+    }
+
+    //lcd.setCursor(lcd_seq_step % LCD::cols, lcd_seq_step >= LCD::cols ? 1 : 0);
+    //lcd.cursor_on();
+    //lcd.blink_on();
+  }
+
+  // Returns whether to redraw or not
+  bool HandlePodControls() {
+    pod.ProcessDigitalControls();
+    pod.ProcessAnalogControls();
+
+    PodState state{};
+    // Knob 1 is for osc detune
+    static float dt{0};
+    float new_dt = detune.Process();
+    if(fabs(dt - new_dt) > 0.001) {
+      state.flags |= PodState::detune_moved;
+      state.detune = new_dt;
+      dt = new_dt;
+    }
+    // Knob 2 morphs the part between its snapshots
+    static float mt{0};
+    float new_mt = morph.Process();
+    bool redraw{false};
+    if(fabs(mt - new_mt) > 0.002) {
+      mt = new_mt;
+      uint8_t p = part - parts;
+      redraw = ApplyMorph(parts[p], mt);
+      daisy::ScopedIrqBlocker block;
+      recorder.record_float(EventType::morph, p, 0, mt);
+    }
+
+    state.inc = pod.encoder.Increment();
+    if(pod.encoder.RisingEdge()) state.flags |= PodState::encoder_rise;
+    if(pod.button1.RisingEdge()) state.flags |= PodState::button1_rise;
+    if(pod.button2.RisingEdge()) state.flags |= PodState::button2_rise;
+    if(pod.button2.FallingEdge()) state.flags |= PodState::button2_fall;
+    if(pod.button2.Pressed()) state.flags |= PodState::button2_held;
+
+    // Holding the encoder down dumps the event log
+    static bool dumped{false};
+    if(pod.encoder.Pressed() && pod.encoder.TimeHeldMs() > 2000) {
+      if(!dumped)
+        recorder.dump();
+      dumped = true;
+    }
+    else
+      dumped = false;
+
+    if(state.idle())
+      return redraw;
+    redraw |= ApplyPodControls(state);
+    daisy::ScopedIrqBlocker block;
+    recorder.record_float(EventType::pod, state.flags, static_cast<uint8_t>(state.inc), state.detune);
+    return redraw;
+  }
+
+  bool ApplyMorph(Part& p, float t) {
+    if(p.morph.get_num_diff() == 0)
+      return false;
+    p.morph.set(t, p.player, p.arp, p.seq, p.patch);
+    std::sprintf(lcd_top, "Morph %i%%", static_cast<int>(100 * t));
+    return true;
+  }
+
+  bool ApplyPodControls(const PodState& state) {
+    Player& player = part->player;
+    Seq& seq = part->seq;
+    Arp& arp = part->arp;
+    bool redraw{false};
+
+    if(state.flags & PodState::detune_moved) {
+      std::sprintf(lcd_top, "Detune %.3i", static_cast<int>(1000 * state.detune));
+      redraw = true;
+      player.set_detune(state.detune);
+    }
+
+    // Encoder turns select the current step
+    int32_t inc = state.inc;
+    if(inc && edit_mode) {
+      seq.step_inc(inc);
+      seq.set_arp(arp);
+      LogPrint("Step Inc %i -> %i\n", inc, seq.get_step_num());
+      redraw = true;
+    }
+    // Out of edit mode they select a pattern bank slot
+    if(inc && !edit_mode) {
+      pattern_slot = (pattern_slot + inc + PatternBank::num_patterns) % PatternBank::num_patterns;
+      print_pattern();
+      redraw = true;
+    }
+    // Encoder Button Release captures the keys as the keys for this step
+    if(state.flags & PodState::encoder_rise) {
+      edit_mode = !edit_mode;
+      if(edit_mode)
+        seq.pause();
+      else
+        seq.unpause();
+      redraw = true;
+    }
+    // Button 1 removes the last note from the current arp
+    // Out of edit mode it queues the selected pattern for the next bar,
+    // or adds it to the chain if button 2 is held
+    if(state.flags & PodState::button1_rise) {
+      if(edit_mode) {
+        seq.pop_note();
+        seq.set_arp(arp);
+      }
+      else if(state.flags & PodState::button2_held) {
+        if(!chaining)
+          seq.chain_clear();
+        chaining = true;
+        seq.chain_append(pattern_slot);
+        print_pattern();
+      }
+      else {
+        seq.queue(pattern_slot);
+        print_pattern();
+      }
+      redraw = true;
+    }
+    // Button 2 inserts a rest
+    if(state.flags & PodState::button2_rise) {
+      if(edit_mode) {
+        seq.push_note(127);
+        seq.set_arp(arp);
+      }
+      //LogPrint("Pod Button2 Click\n");
+      //seq.step(lcd_seq_step).active = !seq.step(lcd_seq_step).active;
+      redraw = true;
+    }
+    // Button 2 on its own out of edit mode stores the pattern in the slot
+    if(state.flags & PodState::button2_fall) {
+      if(!edit_mode && !chaining) {
+        seq.store(pattern_slot);
+        // The other part may be playing it too
+        for(size_t i = 0; i < num_parts; i++)
+          if(&parts[i] != part)
+            parts[i].seq.reload(pattern_slot);
+        std::sprintf(lcd_bot, "Stored Pat %02u", pattern_slot);
+        redraw = true;
+      }
+      chaining = false;
+    }
+    
+    return redraw;
+  }
+
+  // Puts a recorded event back through the same code it originally went
+  // through, see replay()
+  bool Replay(const Event& e, Governor& governor) {
+    Part& p = parts[e.data[0] % num_parts];
+    switch(e.type) {
+      case EventType::midi:
+        {
+          daisy::MidiEvent m{};
+          m.type = static_cast<daisy::MidiMessageType>(e.data[0]);
+          m.channel = e.data[1];
+          m.data[0] = e.data[2];
+          m.data[1] = e.value;
+          return HandleMidiMessage(m);
+        }
+      case EventType::pod:
+        {
+          PodState state{};
+          state.flags = e.data[0];
+          state.inc = static_cast<int8_t>(e.data[1]);
+          state.detune = Recorder::as_float(e);
+          return ApplyPodControls(state);
+        }
+      case EventType::sync:
+        for(size_t i = 0; i < num_parts; i++)
+          parts[i].arp.set_note_len(60. / (e.value * 8.));
+        break;
+      case EventType::arp_tick:
+        p.arp.update(p.player);
+        break;
+      case EventType::seq_tick:
+        p.seq.update(p.player, p.arp, p.patch);
+        break;
+      case EventType::governor:
+        governor.set_level(e.data[0]);
+        break;
+      case EventType::morph:
+        return ApplyMorph(p, Recorder::as_float(e));
+      case EventType::control:
+        ApplyControl(p, e.data[1], e.data[2]);
+        break;
+    }
+    return false;
+  }
+
+  // libDaisy hands over a SysEx message at a time without the F0 / F7.
+  // Dumps come in a packet to a message, see sysex.h.
+  bool HandleSysex(const daisy::MidiEvent& m) {
+    bool redraw = FeedSysex(sysex::start);
+    for(size_t i = 0; i < m.sysex_message_len; i++)
+      redraw |= FeedSysex(m.sysex_data[i]);
+    return FeedSysex(sysex::end) || redraw;
+  }
+
+  bool FeedSysex(uint8_t b) {
+    switch(sysex_in.feed(b)) {
+      case sysex::Result::done:
+        if(sysex_in.cmd() == sysex::Cmd::pattern) {
+          // Nothing plays straight from the bank, parts playing the slot
+          // pick it up at the next bar
+          uint8_t slot = sysex_in.target() % PatternBank::num_patterns;
+          bank.load(slot, sysex_pattern);
+          for(size_t i = 0; i < num_parts; i++)
+            parts[i].seq.reload(slot);
+          std::sprintf(lcd_bot, "Loaded Pat %02u", slot);
+        }
+        else {
+          uint8_t p = sysex_in.target() % num_parts;
+          parts[p].incoming = sysex_patch;
+          parts[p].incoming_ready = true;
+          std::sprintf(lcd_bot, "Loaded Patch %u", p + 1);
+        }
+        return true;
+      case sysex::Result::request:
+        {
+          auto send = [this](uint8_t* bytes, size_t n) { pod.midi.SendMessage(bytes, n); };
+          if(sysex_in.cmd() == sysex::Cmd::pattern_request) {
+            const StoredPattern& pattern = bank.pattern(sysex_in.target());
+            sysex::encode(sysex::Cmd::pattern, sysex_in.target(), reinterpret_cast<const uint8_t*>(&pattern), sizeof(pattern), send);
+          }
+          else {
+            const Patch& patch = parts[sysex_in.target() % num_parts].patch;
+            sysex::encode(sysex::Cmd::patch, sysex_in.target(), patch.values.data(), patch.values.size(), send);
+          }
+        }
+        return false;
+      case sysex::Result::error:
+        std::sprintf(lcd_bot, "SysEx Error");
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  // A loaded patch goes in at the bar so the sound changes all at once.
+  // Each value goes in the log so a replay gets the same patch.
+  void ApplyIncoming(uint8_t p) {
+    Part& part = parts[p];
+    for(uint8_t c = 0; c < num_controls; c++) {
+      uint8_t v = part.incoming[c];
+      if(v == Patch::unset)
+        continue;
+      recorder.record(EventType::control, p, c, v);
+      ApplyControl(part, c, v);
+    }
+    part.incoming_ready = false;
+  }
+
+  void ApplyControl(Part& p, uint8_t c, uint8_t v) {
+    const ControlDesc& desc = control_desc(c);
+    if(!desc.apply || v > 127)
+      return;
+    p.patch.values[c % num_controls] = v;
+    desc.apply(p.player, p.arp, v);
+  }
+
+  Part* find_part(uint8_t channel) {
+    for(size_t i = 0; i < num_parts; i++)
+      if(parts[i].channel == channel)
+        return &parts[i];
+    return nullptr;
+  }
+
+  void status(const char* msg) {
+    std::strncpy(lcd_bot, msg, sizeof(lcd_bot) - 1);
+  }
+
+  void print_pattern() {
+    Seq& seq = part->seq;
+    // Slots are all two digits, the % tells the compiler so
+    static_assert(PatternBank::num_patterns <= 100);
+    unsigned pattern = seq.get_pattern() % 100u;
+    unsigned slot = pattern_slot % 100u;
+    if(seq.get_queued() >= 0)
+      std::snprintf(lcd_bot, sizeof(lcd_bot), "P%02u>%02u [%02u]", pattern, static_cast<unsigned>(seq.get_queued()) % 100u, slot);
+    else
+      std::snprintf(lcd_bot, sizeof(lcd_bot), "P%02u [%02u]", pattern, slot);
+    size_t len = strlen(lcd_bot);
+    if(seq.get_chain_len() > 1)
+      std::snprintf(lcd_bot + len, sizeof(lcd_bot) - len, " C%u", seq.get_chain_len());
+  }
+
+  bool transpose(Part& p, daisy::NoteOnEvent& key, bool press) {
+    bool changed = press ? p.transposer.press(key) : p.transposer.release(key);
+    if(!changed)
+      return false;
+    p.player.set_transpose(p.transposer.get(), p.transposer.legato());
+    std::sprintf(lcd_top, "Transpose %+i", p.transposer.get());
+    return true;
+  }
+
+  bool HandleMidiMessage(daisy::MidiEvent m)
+  {
+    bool redraw = false;
+    if(m.type == daisy::NoteOn || m.type == daisy::NoteOff || m.type == daisy::ControlChange) {
+      Part* target = find_part(m.channel);
+      if(!target)
+        return false;
+      if(target != part)
+        redraw = true;
+      part = target;
+    }
+    Player& player = part->player;
+    Seq& seq = part->seq;
+    Arp& arp = part->arp;
+    Patch& patch = part->patch;
+
+    switch(m.type) {
+      case daisy::NoteOn: 
+        {
+        //keys.press(m.AsNoteOn());
+          daisy::NoteOnEvent n{m.AsNoteOn()};
+          if(edit_mode) {
+            seq.push_note(n.note);
+            seq.set_arp(arp);
+          }
+          // Out of edit mode the keys transpose the running pattern, if
+          // transpose_mode has been turned on
+          else if(n.velocity == 0)
+            transpose(*part, n, false);
+          else
+            transpose(*part, n, true);
+          redraw = true;
+        }
+        break;
+      case daisy::NoteOff: 
+        {
+          daisy::NoteOffEvent off{m.AsNoteOff()};
+          daisy::NoteOnEvent n{off.channel, off.note, 0};
+          if(!edit_mode)
+            redraw = transpose(*part, n, false);
+        }
+        break;
+      case daisy::ControlChange: 
+        {
+          daisy::ControlChangeEvent p = m.AsControlChange();
+          auto mapped = midi_map.find(p.control_number);
+          if(mapped == midi_map.end()) {
+            LogPrint("Control Received: Not Mapped -> %i\n", p.control_number);
+            break;
+          }
+          SynthControl control = mapped->second;
+          LogPrint("Control Received:\t%d\t%d -> %i\n", p.control_number, p.value, control);
+
+          // Plain parameters, in edit mode they're only locked to the
+          // current step. The live sound stays on the patch, the lock
+          // comes in when the step plays.
+          const ControlDesc& desc = control_desc(control);
+          if(desc.apply) {
+            if(edit_mode)
+              seq.get_step().lock(static_cast<uint8_t>(control), p.value);
+            else {
+              patch[control] = p.value;
+              desc.apply(player, arp, p.value);
+            }
+            desc.print(desc.bottom ? lcd_bot : lcd_top, player, p.value);
+            redraw = true;
+            break;
+          }
+
+          switch(static_cast<int>(control)) {
+            case static_cast<int>(SynthControl::seq_pause_toggle): 
+              {
+                seq.pause_toggle();
+              }
+              break;
+            case static_cast<int>(SynthControl::seq_step_length): 
+              {
+                // Up to 100ms between chord notes
+                if(edit_mode) {
+                  uint16_t strum = static_cast<uint16_t>(0.1f * samplerate * p.value / 127.f);
+                  seq.get_step().strum = strum;
+                  redraw = true;
+                  break;
+                }
+                seq.set_tempo(0.002 + 5. * p.value / 127.f);
+                std::sprintf(lcd_top, "Seq Tempo %.3i", static_cast<int>(1000 * (0.002 + 5. * p.value / 127.f)));
+                redraw = true;
+              }
+              break;
+            case static_cast<int>(SynthControl::oscillator_detune): 
+              //player.set_oscillator_detune(p.value);
+              break;
+            case static_cast<int>(SynthControl::mode_toggle):
+              {
+              // Buttons always get a press and a release event
+              // only respond to the press
+              if(p.value != 127)
+                break;
+              }
+              break;
+            case static_cast<int>(SynthControl::arp_mode):
+              {
+                // Buttons always get a press and a release event
+                // only respond to the press
+                if(p.value != 127)
+                  break;
+                if(edit_mode) {
+                  seq.get_step().next_mode();
+                  seq.set_arp(arp);
+                  redraw = true;
+                  break;
+                }
+                arp.next_mode();
+                std::sprintf(lcd_bot, "Arp ");
+                arp.mode_name(lcd_bot + 4);
+                redraw = true;
+              }
+              break;
+            case static_cast<int>(SynthControl::seq_step_add_del):
+              {
+                if(p.value == 65) {
+                  seq.add_step();
+                } else if(p.value == 63) {
+                  seq.del_step();
+                }
+                LogPrint("Step add/remove %i\n", seq.get_num_steps());
+                redraw = true;
+              }
+              break;
+            case static_cast<int>(SynthControl::delay_sync):
+              {
+                uint8_t div = player.get_delay_sync();
+                if(p.value == 65 && div + 1u < delay_divisions.size())
+                  div++;
+                else if(p.value == 63 && div > 0)
+                  div--;
+                player.set_delay_sync(div);
+                std::sprintf(lcd_top, "Delay Sync %s", delay_division_names[div]);
+                redraw = true;
+              }
+              break;
+            case static_cast<int>(SynthControl::step_probability):
+              {
+                if(!edit_mode)
+                  break;
+                seq.get_step().probability = static_cast<uint8_t>(100 * p.value / 127);
+                redraw = true;
+              }
+              break;
+            case static_cast<int>(SynthControl::snapshot_a):
+            case static_cast<int>(SynthControl::snapshot_b):
+              {
+                if(p.value != 127)
+                  break;
+                bool is_a = control == SynthControl::snapshot_a;
+                if(is_a)
+                  part->morph.store_a(patch, player, arp, seq);
+                else
+                  part->morph.store_b(patch, player, arp, seq);
+                std::sprintf(lcd_top, "Snap %c %u diff", is_a ? 'A' : 'B', part->morph.get_num_diff());
+                redraw = true;
+              }
+              break;
+            case static_cast<int>(SynthControl::transpose_mode):
+              {
+                if(p.value != 127)
+                  break;
+                part->transposer.next_mode();
+                player.set_transpose(0, false);
+                std::sprintf(lcd_top, "Transpose ");
+                part->transposer.mode_name(lcd_top + 10);
+                redraw = true;
+              }
+              break;
+            default: 
+              {
+                LogPrint("Control Received: Not Mapped -> %f\n", p.control_number);
+              }
+              break;
+          }
+          break;
+        }
+      default: break;
+    }
+    return redraw;
+  }
+};
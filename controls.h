@@ -0,0 +1,398 @@
+#pragma once
+#include "daisy_pod.h"
+#include "daisysp.h"
+#include <util/MappedValue.h>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include "arp.h"
+#include "midi_in.h"
+#include "player.h"
+#include "tables.h"
+#include "tuning.h"
+
+//#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+#define LogPrint(...)
+
+enum class SynthControl {
+  wave_shape,
+  seq_step_length,
+  seq_pause_toggle,
+  vcf_cutoff,
+  vcf_resonance,
+  vcf_envelope_depth,
+  delay_time,
+  delay_mix,
+  reverb_damp_freq,
+  reverb_feedback,
+  reverb_wet,
+  oscillator_detune,
+  envelope_a_vca,
+  envelope_d_vca,
+  envelope_a_vcf,
+  envelope_d_vcf,
+  mode_toggle,
+  arp_note_length,
+  arp_mode,
+  seq_step_add_del,
+  delay_sync,
+  delay_damp,
+  lfo1_rate,
+  lfo1_cutoff,
+  lfo2_rate,
+  lfo2_pan,
+  tuning_scale,
+  tuning_root,
+  transpose_mode,
+  unison_voices,
+  unison_spread,
+  drive,
+  drive_oversample,
+  snapshot_a,
+  snapshot_b,
+  humanize_velocity,
+  humanize_time,
+  arp_skip,
+  step_probability,
+  arp_octaves,
+  euclid_steps,
+  euclid_hits,
+  euclid_rotate,
+  arp_ratchet,
+  arp_ratchet_every,
+  midi_out_notes,
+  midi_out_clock,
+  midi_in_filter,
+  sample_select,
+  input_mode,
+  input_gate,
+  lfo1_shape,
+  lfo2_shape,
+  lfo1_delay_mix,
+  lfo2_detune,
+  Count
+};
+
+constexpr size_t num_controls{static_cast<size_t>(SynthControl::Count)};
+
+// How a control value (midi 0-127) gets onto the synth and the LCD.
+// Controls that just set a parameter live in this table so the midi
+// handler, parameter locks etc. all go through the same code. The rest
+// (buttons, sequencer controls) are still handled in the Controller.
+struct ControlDesc {
+  void (*apply)(Player& player, Arp& arp, float value);
+  void (*print)(char* out, Player& player, float value);
+  bool bottom; // which LCD line it prints on
+  bool discrete{false}; // switched rather than interpolated by a Morph
+};
+
+constexpr std::array<ControlDesc, num_controls> make_control_descs() {
+  std::array<ControlDesc, num_controls> d{};
+  auto set = [&d](SynthControl c, ControlDesc desc) { d[static_cast<size_t>(c)] = desc; };
+
+  set(SynthControl::wave_shape, {
+      [](Player& p, Arp&, float v) { p.set_wave_shape(static_cast<uint8_t>(8 * v / 127.0)); },
+      [](char* out, Player&, float v) {
+        char tmp[25]{0,};
+        wave_name(tmp, static_cast<uint8_t>(8 * v / 127.0));
+        std::sprintf(out, "Shape %s", tmp);
+      },
+      true, true});
+  set(SynthControl::vcf_cutoff, {
+      [](Player& p, Arp&, float v) { p.set_vcf_cutoff(v / 127.0); },
+      [](char* out, Player& p, float v) {
+        static daisy::MappedFloatValue vcf_freq_map{
+          100, p.get_samplerate() / 3  + 1, 440,
+            daisy::MappedFloatValue::Mapping::log, "Hz"};
+        vcf_freq_map.SetFrom0to1(v / 127.0);
+        std::sprintf(out, "VCF C %i", static_cast<int>(vcf_freq_map.Get()));
+      },
+      false});
+  set(SynthControl::vcf_resonance, {
+      [](Player& p, Arp&, float v) { p.set_vcf_resonance((1.0 + v) / 129.0); },
+      [](char* out, Player&, float v) { std::sprintf(out, "VCF R %.3i", static_cast<int>(1000 * (1. + v) / 129.0)); },
+      false});
+  set(SynthControl::vcf_envelope_depth, {
+      [](Player& p, Arp&, float v) { p.set_vcf_envelope_depth(v / 127.0); },
+      [](char* out, Player&, float v) { std::sprintf(out, "VCF Env %.3i", static_cast<int>(1000 * v / 127.0)); },
+      false});
+  set(SynthControl::envelope_a_vca, {
+      [](Player& p, Arp&, float v) { p.set_envelope_a_vca(tables::cc_lookup(tables::cc_env_secs, v)); },
+      [](char* out, Player&, float v) { std::sprintf(out, "VCA Env A %.3i", static_cast<int>(1000 * v / 127.0)); },
+      false});
+  set(SynthControl::envelope_d_vca, {
+      [](Player& p, Arp&, float v) { p.set_envelope_d_vca(tables::cc_lookup(tables::cc_env_secs, v)); },
+      [](char* out, Player&, float v) { std::sprintf(out, "VCA Env D %.3i", static_cast<int>(1000 * v / 127.0)); },
+      false});
+  set(SynthControl::envelope_a_vcf, {
+      [](Player& p, Arp&, float v) { p.set_envelope_a_vcf(tables::cc_lookup(tables::cc_env_secs, v)); },
+      [](char* out, Player&, float v) { std::sprintf(out, "VCF Env A %.3i", static_cast<int>(1000 * v / 127.0)); },
+      false});
+  set(SynthControl::envelope_d_vcf, {
+      [](Player& p, Arp&, float v) { p.set_envelope_d_vcf(tables::cc_lookup(tables::cc_env_secs, v)); },
+      [](char* out, Player&, float v) { std::sprintf(out, "VCF Env D %.3i", static_cast<int>(1000 * v / 127.0)); },
+      false});
+  set(SynthControl::arp_note_length, {
+      [](Player&, Arp& a, float v) { a.set_note_len(0.002 + 0.25 * v / 127.f); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Arp Len %.3i", static_cast<int>(1000 * (0.002 + 0.25 * v / 127.f))); },
+      false});
+  set(SynthControl::delay_time, {
+      // Delay time is in samples
+      [](Player& p, Arp&, float v) { p.set_delay_time(p.get_samplerate() * v / 127.0); },
+      [](char* out, Player& p, float v) { std::sprintf(out, "Delay T %.3i", static_cast<int>(p.get_samplerate() * v / 127.)); },
+      false});
+  set(SynthControl::delay_mix, {
+      [](Player& p, Arp&, float v) { p.set_delay_mix(v / 127.0); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Delay Mix %.3i", static_cast<int>(1000 * v / 127.f)); },
+      false});
+  set(SynthControl::delay_damp, {
+      [](Player& p, Arp&, float v) { p.set_delay_damp_freq(tables::cc_lookup(tables::cc_damp_freq, v)); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Delay Damp %i", static_cast<int>(tables::cc_lookup(tables::cc_damp_freq, v))); },
+      false});
+  set(SynthControl::reverb_feedback, {
+      [](Player& p, Arp&, float v) { p.set_reverb_feedback(v / 127.0); },
+      [](char* out, Player& p, float v) {
+        static daisy::MappedFloatValue rv_freq_map{
+          100, p.get_samplerate() / 3  + 1, 440,
+            daisy::MappedFloatValue::Mapping::log, "Hz"};
+        rv_freq_map.SetFrom0to1(v / 127.0);
+        std::sprintf(out, "Rev FB %.4i", static_cast<int>(rv_freq_map.Get()));
+      },
+      false});
+  set(SynthControl::reverb_damp_freq, {
+      [](Player&, Arp&, float) { /*p.set_reverb_damp_freq(v / 127.0);*/ },
+      [](char* out, Player&, float v) { std::sprintf(out, "Rev Damp %.3i", static_cast<int>(1000 * v / 127.f)); },
+      false});
+  set(SynthControl::reverb_wet, {
+      [](Player& p, Arp&, float v) { p.set_reverb_wet(v / 127.0); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Rev wet %.3i", static_cast<int>(1000 * v / 127.f)); },
+      false});
+  set(SynthControl::lfo1_rate, {
+      [](Player& p, Arp&, float v) { p.set_lfo_rate(0, 0.05f + 10.0f * v * v / (127.0f * 127.0f)); },
+      [](char* out, Player&, float v) { std::sprintf(out, "LFO1 Rate %.3i", static_cast<int>(1000 * (0.05f + 10.0f * v * v / (127.0f * 127.0f)))); },
+      false});
+  set(SynthControl::lfo1_cutoff, {
+      [](Player& p, Arp&, float v) { p.set_mod_depth(ModSource::lfo1, ModDest::cutoff, 0.5f * v / 127.0f); },
+      [](char* out, Player&, float v) { std::sprintf(out, "LFO1>VCF %.3i", static_cast<int>(1000 * 0.5f * v / 127.0f)); },
+      false});
+  set(SynthControl::lfo2_rate, {
+      [](Player& p, Arp&, float v) { p.set_lfo_rate(1, 0.05f + 10.0f * v * v / (127.0f * 127.0f)); },
+      [](char* out, Player&, float v) { std::sprintf(out, "LFO2 Rate %.3i", static_cast<int>(1000 * (0.05f + 10.0f * v * v / (127.0f * 127.0f)))); },
+      false});
+  set(SynthControl::lfo2_pan, {
+      [](Player& p, Arp&, float v) { p.set_mod_depth(ModSource::lfo2, ModDest::pan, v / 127.0f); },
+      [](char* out, Player&, float v) { std::sprintf(out, "LFO2>Pan %.3i", static_cast<int>(1000 * v / 127.0f)); },
+      false});
+  set(SynthControl::lfo1_shape, {
+      [](Player& p, Arp&, float v) { p.set_lfo_shape(0, static_cast<LfoShape>(static_cast<uint8_t>(4 * v / 128.0f))); },
+      [](char* out, Player&, float v) { std::sprintf(out, "LFO1 %s", lfo_shape_name(static_cast<LfoShape>(static_cast<uint8_t>(4 * v / 128.0f)))); },
+      false, true});
+  set(SynthControl::lfo2_shape, {
+      [](Player& p, Arp&, float v) { p.set_lfo_shape(1, static_cast<LfoShape>(static_cast<uint8_t>(4 * v / 128.0f))); },
+      [](char* out, Player&, float v) { std::sprintf(out, "LFO2 %s", lfo_shape_name(static_cast<LfoShape>(static_cast<uint8_t>(4 * v / 128.0f)))); },
+      false, true});
+  set(SynthControl::lfo1_delay_mix, {
+      [](Player& p, Arp&, float v) { p.set_mod_depth(ModSource::lfo1, ModDest::delay_mix, 0.5f * v / 127.0f); },
+      [](char* out, Player&, float v) { std::sprintf(out, "LFO1>Dly %.3i", static_cast<int>(1000 * 0.5f * v / 127.0f)); },
+      false});
+  set(SynthControl::lfo2_detune, {
+      // Up to 10% either way on osc2, a vibrato between the oscillators
+      [](Player& p, Arp&, float v) { p.set_mod_depth(ModSource::lfo2, ModDest::detune, 0.1f * v / 127.0f); },
+      [](char* out, Player&, float v) { std::sprintf(out, "LFO2>Det %.3i", static_cast<int>(1000 * 0.1f * v / 127.0f)); },
+      false});
+  // The tuning is shared, setting it on either part sets it for both
+  set(SynthControl::tuning_scale, {
+      [](Player&, Arp&, float v) { tuning.load_scala(tuning_presets[static_cast<size_t>(tuning_presets.size() * v / 128.0f)]); },
+      [](char* out, Player&, float v) {
+        // The description line, after the ! comment
+        const char* name = std::strchr(tuning_presets[static_cast<size_t>(tuning_presets.size() * v / 128.0f)], '\n') + 1;
+        std::sprintf(out, "%.*s", static_cast<int>(std::strchr(name, '\n') - name), name);
+      },
+      false, true});
+  set(SynthControl::tuning_root, {
+      [](Player&, Arp&, float v) { tuning.set_root(static_cast<uint8_t>(v)); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Root %u", static_cast<unsigned>(v)); },
+      false, true});
+  // On from 64, out on the part's own channel
+  set(SynthControl::midi_out_notes, {
+      [](Player& p, Arp&, float v) { p.set_midi_out(v >= 64 ? p.get_channel() : -1); },
+      [](char* out, Player&, float v) { std::sprintf(out, "MIDI Out %s", v >= 64 ? "On" : "Off"); },
+      false, true});
+  // The clock is shared, like the tuning
+  set(SynthControl::midi_out_clock, {
+      [](Player&, Arp&, float v) { midi_out.set_clock(v >= 64); },
+      [](char* out, Player&, float v) { std::sprintf(out, "MIDI Clock %s", v >= 64 ? "On" : "Off"); },
+      false, true});
+  // Which inputs play which parts, shared like the tuning
+  set(SynthControl::midi_in_filter, {
+      [](Player&, Arp&, float v) { midi_in.set_filter(static_cast<MidiIn::Filter>(static_cast<uint8_t>(4 * v / 128.0f))); },
+      [](char* out, Player&, float v) { std::sprintf(out, "MIDI In %s", MidiIn::filter_name(static_cast<MidiIn::Filter>(static_cast<uint8_t>(4 * v / 128.0f)))); },
+      false, true});
+  // 0 is the oscillators, then 0.wav to 7.wav
+  set(SynthControl::sample_select, {
+      [](Player& p, Arp&, float v) {
+        size_t slot = (Sampler::num_slots + 1) * static_cast<size_t>(v) / 128;
+        p.set_sample(slot ? sampler.slot(slot - 1) : nullptr);
+      },
+      [](char* out, Player&, float v) {
+        size_t slot = (Sampler::num_slots + 1) * static_cast<size_t>(v) / 128;
+        if(!slot)
+          std::sprintf(out, "Sample Off");
+        else
+          std::sprintf(out, sampler.slot(slot - 1) ? "Sample %u" : "Sample %u None", static_cast<unsigned>(slot - 1));
+      },
+      false, true});
+  // Three zones, off, right, stereo
+  set(SynthControl::input_mode, {
+      [](Player& p, Arp&, float v) { p.set_input_mode(static_cast<InputMode>(static_cast<uint8_t>(3 * v / 128.0f))); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Input %s", input_mode_name(static_cast<InputMode>(static_cast<uint8_t>(3 * v / 128.0f)))); },
+      false, true});
+  // On from 64
+  set(SynthControl::input_gate, {
+      [](Player& p, Arp&, float v) { p.set_input_gate(v >= 64); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Input Gate %s", v >= 64 ? "On" : "Off"); },
+      false, true});
+  set(SynthControl::unison_voices, {
+      [](Player& p, Arp&, float v) { p.set_unison(1 + static_cast<size_t>(8 * v / 128.0f)); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Unison %u", 1 + static_cast<unsigned>(8 * v / 128.0f)); },
+      false, true});
+  set(SynthControl::unison_spread, {
+      [](Player& p, Arp&, float v) { p.set_unison_spread(v / 127.0f); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Uni Spread %.3i", static_cast<int>(1000 * v / 127.0f)); },
+      false});
+  set(SynthControl::drive, {
+      [](Player& p, Arp&, float v) { p.set_drive(v / 127.0f); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Drive %.3i", static_cast<int>(1000 * v / 127.0f)); },
+      false});
+  set(SynthControl::drive_oversample, {
+      [](Player& p, Arp&, float v) { p.set_drive_oversample(1 << static_cast<uint8_t>(3 * v / 128.0f)); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Drive OS %ux", 1u << static_cast<uint8_t>(3 * v / 128.0f)); },
+      false, true});
+  set(SynthControl::humanize_velocity, {
+      [](Player& p, Arp&, float v) { p.set_humanize_velocity(static_cast<uint8_t>(v / 2)); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Human Vel %i", static_cast<int>(v / 2)); },
+      false});
+  set(SynthControl::humanize_time, {
+      // Up to 20ms late
+      [](Player& p, Arp&, float v) { p.set_humanize_time(static_cast<uint16_t>(0.02f * p.get_samplerate() * v / 127.0f)); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Human Time %ims", static_cast<int>(20 * v / 127.0f)); },
+      false});
+  set(SynthControl::arp_skip, {
+      [](Player&, Arp& a, float v) { a.set_skip(static_cast<uint8_t>(100 * v / 127.0f)); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Arp Skip %i%%", static_cast<int>(100 * v / 127.0f)); },
+      false});
+  set(SynthControl::arp_octaves, {
+      [](Player&, Arp& a, float v) { a.set_octaves(1 + static_cast<uint8_t>(4 * v / 128.0f)); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Arp Oct %u", 1 + static_cast<unsigned>(4 * v / 128.0f)); },
+      false, true});
+  set(SynthControl::euclid_steps, {
+      [](Player&, Arp& a, float v) { a.set_euclid_steps(1 + static_cast<uint8_t>(v / 4)); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Euclid Steps %u", 1 + static_cast<unsigned>(v / 4)); },
+      false, true});
+  set(SynthControl::euclid_hits, {
+      [](Player&, Arp& a, float v) { a.set_euclid_hits(1 + static_cast<uint8_t>(v / 4)); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Euclid Hits %u", 1 + static_cast<unsigned>(v / 4)); },
+      false, true});
+  set(SynthControl::euclid_rotate, {
+      [](Player&, Arp& a, float v) { a.set_euclid_rotate(static_cast<uint8_t>(v / 4)); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Euclid Rot %u", static_cast<unsigned>(v / 4)); },
+      false, true});
+  set(SynthControl::arp_ratchet, {
+      [](Player&, Arp& a, float v) { a.set_ratchet(1 + static_cast<uint8_t>(4 * v / 128.0f)); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Ratchet %ux", 1 + static_cast<unsigned>(4 * v / 128.0f)); },
+      false, true});
+  set(SynthControl::arp_ratchet_every, {
+      [](Player&, Arp& a, float v) { a.set_ratchet_every(1 + static_cast<uint8_t>(8 * v / 128.0f)); },
+      [](char* out, Player&, float v) { std::sprintf(out, "Ratchet /%u", 1 + static_cast<unsigned>(8 * v / 128.0f)); },
+      false, true});
+  return d;
+}
+
+inline constexpr std::array<ControlDesc, num_controls> control_descs{make_control_descs()};
+
+inline const ControlDesc& control_desc(SynthControl c) { return control_descs[static_cast<size_t>(c)]; }
+inline const ControlDesc& control_desc(uint8_t c) { return control_descs[c % num_controls]; }
+
+// The last value received for every control, used to put things back
+// after a parameter lock
+struct Patch {
+  static constexpr uint8_t unset{0xFF};
+  std::array<uint8_t, num_controls> values;
+
+  Patch() { values.fill(unset); }
+
+  uint8_t& operator[](SynthControl c) { return values[static_cast<size_t>(c)]; }
+  uint8_t operator[](uint8_t c) const { return values[c % num_controls]; }
+};
+
+// What every parameter control starts at. Each Part applies these at
+// boot, so its Patch has a value for a lock to go back to. Close to what
+// the Player, Arp and FxBus set up on their own.
+inline constexpr std::array<std::pair<SynthControl, uint8_t>, 44> control_defaults{{
+  {SynthControl::wave_shape, 96}, // polyblep saw
+  {SynthControl::vcf_cutoff, 127},
+  {SynthControl::vcf_resonance, 0},
+  {SynthControl::vcf_envelope_depth, 0},
+  {SynthControl::envelope_a_vca, 5}, // ~50ms, the AdEnv default
+  {SynthControl::envelope_d_vca, 5},
+  {SynthControl::envelope_a_vcf, 5},
+  {SynthControl::envelope_d_vcf, 5},
+  {SynthControl::arp_note_length, 5},
+  {SynthControl::delay_time, 0},
+  {SynthControl::delay_mix, 0},
+  {SynthControl::delay_damp, 119}, // 12kHz
+  {SynthControl::reverb_feedback, 108}, // 0.85
+  {SynthControl::reverb_damp_freq, 127},
+  {SynthControl::reverb_wet, 0},
+  {SynthControl::lfo1_rate, 39}, // 1Hz
+  {SynthControl::lfo1_cutoff, 0},
+  {SynthControl::lfo2_rate, 39},
+  {SynthControl::lfo2_pan, 0},
+  {SynthControl::lfo1_shape, 0}, // sine
+  {SynthControl::lfo2_shape, 0},
+  {SynthControl::lfo1_delay_mix, 0},
+  {SynthControl::lfo2_detune, 0},
+  {SynthControl::tuning_scale, 0}, // 12-TET
+  {SynthControl::tuning_root, 60},
+  {SynthControl::midi_out_notes, 0},
+  {SynthControl::midi_out_clock, 0},
+  {SynthControl::midi_in_filter, 0}, // both inputs, every channel
+  {SynthControl::sample_select, 0}, // the oscillators
+  {SynthControl::input_mode, 0}, // off
+  {SynthControl::input_gate, 0},
+  {SynthControl::unison_voices, 0},
+  {SynthControl::unison_spread, 25},
+  {SynthControl::drive, 0},
+  {SynthControl::drive_oversample, 64}, // 2x
+  {SynthControl::humanize_velocity, 0},
+  {SynthControl::humanize_time, 0},
+  {SynthControl::arp_skip, 0},
+  {SynthControl::arp_octaves, 0},
+  {SynthControl::euclid_steps, 0},
+  {SynthControl::euclid_hits, 0},
+  {SynthControl::euclid_rotate, 0},
+  {SynthControl::arp_ratchet, 0},
+  {SynthControl::arp_ratchet_every, 0},
+}};
+
+constexpr bool control_defaults_complete() {
+  for(size_t c = 0; c < num_controls; c++) {
+    if(!control_descs[c].apply)
+      continue;
+    bool found = false;
+    for(const auto& d : control_defaults)
+      found |= static_cast<size_t>(d.first) == c;
+    if(!found)
+      return false;
+  }
+  return true;
+}
+static_assert(control_defaults_complete(), "every control in control_descs needs a default");
+
+// A per step override of one control, see Step
+struct ParamLock {
+  uint8_t control;
+  uint8_t value;
+};
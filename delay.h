@@ -0,0 +1,101 @@
+#pragma once
+#include "daisy_pod.h"
+#include "daisysp.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+//#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+#define LogPrint(...)
+
+// Samples are stored as int16 in SDRAM, 1 sec at 48kHz is 96 KB
+constexpr size_t delay_max_samples{48000};
+static int16_t DSY_SDRAM_BSS delay_buffer[delay_max_samples];
+
+// Tempo synced delay times in sequencer steps, 0 is free running
+constexpr std::array<float, 11> delay_divisions{0, 0.25, 1. / 3., 0.5, 2. / 3., 0.75, 1, 1.5, 2, 3, 4};
+constexpr std::array<const char*, 11> delay_division_names{
+  "free", "1/4", "1/3", "1/2", "2/3", "3/4", "1", "3/2", "2", "3", "4"};
+
+// Delay line that glides to a new delay time instead of jumping the read
+// head, with a low pass in the feedback path.
+class Delay {
+  float samplerate{0};
+  size_t write_pos{0};
+
+  float target{1}; // samples
+  float current{1};
+  float glide{0};
+
+  float free_time{1}; // samples
+  float step_secs{0};
+  uint8_t division{0};
+
+  float damp{1};
+  float lp{0};
+
+  public:
+  void Init(float sr) {
+    samplerate = sr;
+    // SDRAM isn't zeroed at boot
+    for(auto& s : delay_buffer)
+      s = 0;
+    write_pos = 0;
+    // ~50ms to settle on a new delay time
+    glide = 1.0f / (0.05f * samplerate);
+    set_damp_freq(12000);
+  }
+
+  void set_delay(float samples) {
+    free_time = samples;
+    update_target();
+  }
+
+  // Step length of the sequencer, only used when synced
+  void set_step_secs(float secs) {
+    if(secs == step_secs)
+      return;
+    step_secs = secs;
+    update_target();
+  }
+
+  void set_division(uint8_t div) {
+    division = div % delay_divisions.size();
+    update_target();
+  }
+  uint8_t get_division() { return division; }
+
+  void set_damp_freq(float freq) {
+    damp = 1.0f - expf(-2.0f * static_cast<float>(M_PI) * freq / samplerate);
+  }
+
+  // Filtered delayed signal
+  float Read() {
+    daisysp::fonepole(current, target, glide);
+    float pos = static_cast<float>(write_pos) - current;
+    if(pos < 0)
+      pos += delay_max_samples;
+    size_t i0 = static_cast<size_t>(pos);
+    size_t i1 = (i0 + 1) % delay_max_samples;
+    float frac = pos - i0;
+    float a = delay_buffer[i0];
+    float b = delay_buffer[i1];
+    float sig = (a + (b - a) * frac) * (1.0f / 32767.0f);
+    lp += damp * (sig - lp);
+    return lp;
+  }
+
+  void Write(float sig) {
+    sig = daisysp::fclamp(sig, -1.0f, 1.0f);
+    delay_buffer[write_pos] = static_cast<int16_t>(sig * 32767.0f);
+    write_pos = (write_pos + 1) % delay_max_samples;
+  }
+
+  private:
+  void update_target() {
+    float t = free_time;
+    if(division > 0 && step_secs > 0)
+      t = delay_divisions[division] * step_secs * samplerate;
+    target = daisysp::fclamp(t, 1.0f, delay_max_samples - 2.0f);
+  }
+};
@@ -0,0 +1,137 @@
+#pragma once
+#include "daisy_pod.h"
+#include "daisysp.h"
+#include <array>
+#include <cstdint>
+
+#include "placement.h"
+#include "tables.h"
+
+//#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+#define LogPrint(...)
+
+// Saturation with 2x / 4x oversampling so the harmonics it adds above
+// nyquist get filtered off instead of folding back down.
+//
+// Each 2x step is a 31 tap halfband FIR (kaiser, beta 4): flat to 0.2 of
+// the oversampled rate, -46dB from 0.3. Only the 8 side taps either way
+// are non zero apart from the centre, so per input sample a step costs
+// 8 mults up and 8 down. Rough M7 cycles per sample and channel:
+//   1x ~10, 2x ~60, 4x ~180
+
+// Side taps of the halfband, the centre tap is 0.5
+constexpr std::array<float, 8> halfband_taps{
+  0.316362317f, -0.09911684f, 0.052386163f, -0.030691707f,
+  0.018012889f, -0.010003291f, 0.004930987f, -0.001880519f};
+
+// tanh from the table, within 0.001
+inline float soft_clip(float x) { return tables::tanh(x); }
+
+// Last n inputs in a doubled ring so they can be read without wrapping,
+// at(k) is the input k samples ago
+template <size_t n>
+class History {
+  std::array<float, 2 * n> buf{};
+  size_t pos{0};
+
+  public:
+  void push(float x) {
+    pos = pos == 0 ? n - 1 : pos - 1;
+    buf[pos] = x;
+    buf[pos + n] = x;
+  }
+  float at(size_t k) const { return buf[pos + k]; }
+};
+
+class Halfband {
+  static constexpr size_t m{halfband_taps.size()};
+
+  History<2 * m> in;    // upsampler input
+  History<2 * m> odd;   // decimator odd phase
+  History<m> even;      // decimator even phase, just a delay
+
+  // The non trivial polyphase branch, taps are symmetric about m - 0.5
+  template <size_t len>
+  static float branch(const History<len>& h) {
+    float sum = 0;
+    for(size_t j = 0; j < m; j++)
+      sum += halfband_taps[j] * (h.at(m - 1 - j) + h.at(m + j));
+    return sum;
+  }
+
+  public:
+  // One sample in, two out at twice the rate
+  void up(float x, float* out) {
+    in.push(x);
+    out[0] = 2.0f * branch(in);
+    out[1] = in.at(m - 1);
+  }
+
+  // Two samples in, one out at half the rate
+  float down(const float* x) {
+    even.push(x[0]);
+    odd.push(x[1]);
+    return branch(odd) + 0.5f * even.at(m - 1);
+  }
+};
+
+class Drive {
+  public:
+  static constexpr size_t max_block{64};
+
+  private:
+  uint8_t factor{2};
+  float gain{1};
+  float level{1};
+  bool on{false};
+
+  Halfband hb1; // base rate <-> 2x
+  Halfband hb2; // 2x <-> 4x
+  float os2[2 * max_block];
+  float os4[4 * max_block];
+
+  public:
+  // 0 is off
+  void set_amount(float amount) {
+    on = amount > 0.0f;
+    gain = 1.0f + 15.0f * amount * amount;
+    // Keep the level roughly where it was as it gets pushed into the clip
+    level = 1.0f / (1.0f + 0.25f * (gain - 1.0f));
+  }
+
+  // 1, 2 or 4
+  void set_oversample(uint8_t f) { factor = f >= 4 ? 4 : (f >= 2 ? 2 : 1); }
+  uint8_t get_oversample() { return factor; }
+
+  // In place, n <= max_block
+  HOT_CODE void process(float* buf, size_t n) {
+    if(!on)
+      return;
+    switch(factor) {
+      case 1:
+        for(size_t i = 0; i < n; i++)
+          buf[i] = soft_clip(buf[i] * gain) * level;
+        break;
+      case 2:
+        for(size_t i = 0; i < n; i++)
+          hb1.up(buf[i], &os2[2 * i]);
+        for(size_t i = 0; i < 2 * n; i++)
+          os2[i] = soft_clip(os2[i] * gain);
+        for(size_t i = 0; i < n; i++)
+          buf[i] = hb1.down(&os2[2 * i]) * level;
+        break;
+      default:
+        for(size_t i = 0; i < n; i++)
+          hb1.up(buf[i], &os2[2 * i]);
+        for(size_t i = 0; i < 2 * n; i++)
+          hb2.up(os2[i], &os4[2 * i]);
+        for(size_t i = 0; i < 4 * n; i++)
+          os4[i] = soft_clip(os4[i] * gain);
+        for(size_t i = 0; i < 2 * n; i++)
+          os2[i] = hb2.down(&os4[2 * i]);
+        for(size_t i = 0; i < n; i++)
+          buf[i] = hb1.down(&os2[2 * i]) * level;
+        break;
+    }
+  }
+};
@@ -0,0 +1,159 @@
+#pragma once
+#include "daisy_pod.h"
+#include "daisysp.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include "placement.h"
+
+//#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+#define LogPrint(...)
+
+// Feedback delay network reverb, cheaper than ReverbSc and scalable by
+// the number of delay lines.
+//
+// The lines live back to back in SDRAM. Audio is processed a block at a
+// time: each line's block is read in one sequential run, mixed in SRAM
+// and written back in one run, so SDRAM only sees short bursts instead of
+// N scattered accesses per sample.
+
+// Mutually prime lengths, ordered so the first 4 / 8 are spread out
+constexpr std::array<size_t, 16> fdn_lengths{
+  1031, 2819, 1801, 4111, 1327, 3329, 2269, 4637,
+  1523, 3079, 2053, 4363, 1151, 3613, 2531, 4909};
+
+constexpr size_t fdn_total_length() {
+  size_t total = 0;
+  for(auto l : fdn_lengths)
+    total += l;
+  return total;
+}
+
+static float DSY_SDRAM_BSS fdn_buffer[fdn_total_length()];
+
+class FdnReverb {
+  public:
+  static constexpr size_t max_lines{fdn_lengths.size()};
+  // Blocks are split into chunks this long, must be shorter than the
+  // shortest line
+  static constexpr size_t max_block{64};
+
+  private:
+  float samplerate{0};
+  size_t lines{8};
+  float feedback{0.85};
+  float damp{1};
+  float norm{1};
+
+  std::array<float*, max_lines> line{};
+  std::array<size_t, max_lines> pos{};
+  std::array<float, max_lines> lp{};
+
+  // SRAM scratch, one block per line
+  float scratch[max_lines][max_block];
+
+  public:
+  void Init(float sr) {
+    samplerate = sr;
+    float* p = fdn_buffer;
+    for(size_t i = 0; i < max_lines; i++) {
+      line[i] = p;
+      p += fdn_lengths[i];
+    }
+    clear(0, max_lines);
+    set_lines(lines);
+    set_lp_freq(10000);
+  }
+
+  // 4, 8 or 16. Called from the main loop, newly used lines are cleared
+  // before the audio side starts reading them.
+  void set_lines(size_t n) {
+    n = n >= 16 ? 16 : (n >= 8 ? 8 : 4);
+    if(n > lines)
+      clear(lines, n);
+    norm = 1.0f / sqrtf(static_cast<float>(n));
+    lines = n;
+  }
+  size_t get_lines() { return lines; }
+
+  void set_feedback(float fb) { feedback = daisysp::fclamp(fb, 0.0f, 0.98f); }
+  void set_lp_freq(float freq) {
+    damp = 1.0f - expf(-2.0f * static_cast<float>(M_PI) * freq / samplerate);
+  }
+
+  void Process(const float* in, float* out_l, float* out_r, size_t size) {
+    while(size > 0) {
+      size_t n = size < max_block ? size : max_block;
+      process_chunk(in, out_l, out_r, n);
+      in += n;
+      out_l += n;
+      out_r += n;
+      size -= n;
+    }
+  }
+
+  private:
+  void clear(size_t from, size_t to) {
+    for(size_t i = from; i < to; i++) {
+      for(size_t j = 0; j < fdn_lengths[i]; j++)
+        line[i][j] = 0;
+      pos[i] = 0;
+      lp[i] = 0;
+    }
+  }
+
+  HOT_CODE void process_chunk(const float* in, float* out_l, float* out_r, size_t n) {
+    const size_t nl = lines;
+    // Sequential reads out of SDRAM
+    for(size_t k = 0; k < nl; k++) {
+      size_t p = pos[k];
+      for(size_t i = 0; i < n; i++) {
+        scratch[k][i] = line[k][p];
+        if(++p >= fdn_lengths[k])
+          p = 0;
+      }
+    }
+
+    float gain = feedback * norm;
+    float v[max_lines];
+    for(size_t i = 0; i < n; i++) {
+      float l = 0, r = 0;
+      for(size_t k = 0; k < nl; k++) {
+        lp[k] += damp * (scratch[k][i] - lp[k]);
+        v[k] = lp[k];
+        if(k & 1)
+          r += v[k];
+        else
+          l += v[k];
+      }
+      out_l[i] = l * norm;
+      out_r[i] = r * norm;
+
+      // Fast Walsh-Hadamard transform, lossless mixing of all lines
+      for(size_t h = 1; h < nl; h <<= 1) {
+        for(size_t j = 0; j < nl; j += h << 1) {
+          for(size_t k = j; k < j + h; k++) {
+            float a = v[k];
+            float b = v[k + h];
+            v[k] = a + b;
+            v[k + h] = a - b;
+          }
+        }
+      }
+      for(size_t k = 0; k < nl; k++)
+        scratch[k][i] = v[k] * gain + ((k & 2) ? -in[i] : in[i]);
+    }
+
+    // Sequential writes back to SDRAM
+    for(size_t k = 0; k < nl; k++) {
+      size_t p = pos[k];
+      for(size_t i = 0; i < n; i++) {
+        line[k][p] = scratch[k][i];
+        if(++p >= fdn_lengths[k])
+          p = 0;
+      }
+      pos[k] = p;
+    }
+  }
+};
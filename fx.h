@@ -0,0 +1,167 @@
+#pragma once
+#include "daisy_pod.h"
+#include "daisysp.h"
+#include <util/MappedValue.h>
+#include <algorithm>
+#include <cstdint>
+
+#include "delay.h"
+#include "fdn.h"
+#include "placement.h"
+
+//#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+#define LogPrint(...)
+
+static uint32_t DSY_SDRAM_BSS reverb_heap[sizeof(daisysp::ReverbSc)];
+
+// Reverb quality, cheapest first. The cycle counts are rough per sample
+// figures for the M7 from counting the inner loops, check them against
+// the load meter on a real unit.
+enum class ReverbTier {
+  off,   // ~0
+  fdn4,  // ~70
+  fdn8,  // ~150
+  fdn16, // ~330
+  sc,    // ~600, the original ReverbSc
+  Count
+};
+
+// Pick per unit with make REVERB_TIER=n, see ReverbTier
+#ifndef REVERB_TIER
+#define REVERB_TIER 4
+#endif
+
+// The delay and reverb shared by every part. Parts add their dry signal
+// into the bus buffers each block, then the bus runs the effects once and
+// writes the output.
+class FxBus {
+  public:
+  static constexpr size_t max_block{FdnReverb::max_block};
+
+  private:
+  float samplerate{0};
+
+  Delay delay;
+  float delay_mix{0};
+  float delay_mix_mod{0}; // summed from the parts each block
+
+  daisysp::ReverbSc* reverb = new(reverb_heap) daisysp::ReverbSc();
+  FdnReverb fdn;
+  ReverbTier reverb_tier{static_cast<ReverbTier>(REVERB_TIER)};
+  float reverb_wet{0.0};
+  float reverb_gain{0.25}; // Reverb output is SUPER LOUD so cut it
+
+  float wet_l[max_block];
+  float wet_r[max_block];
+
+  public:
+  // Filled by the parts, mono goes to the effects, left / right is the
+  // panned dry signal
+  float mono[max_block];
+  float left[max_block];
+  float right[max_block];
+
+  void Init(float sr) {
+    samplerate = sr;
+    delay.Init(samplerate);
+    reverb->Init(samplerate);
+    reverb->SetLpFreq(18000.0f);
+    reverb->SetFeedback(0.85f);
+    fdn.Init(samplerate);
+    set_reverb_tier(reverb_tier);
+  }
+
+  void begin(size_t n) {
+    std::fill(mono, mono + n, 0.0f);
+    std::fill(left, left + n, 0.0f);
+    std::fill(right, right + n, 0.0f);
+    delay_mix_mod = 0;
+  }
+
+  void add_delay_mix_mod(float m) { delay_mix_mod += m; }
+
+  HOT_CODE void process(daisy::AudioHandle::InterleavingOutputBuffer out, size_t n) {
+    float dmix = daisysp::fclamp(delay_mix + delay_mix_mod, 0.0f, 1.0f);
+    for(size_t i = 0; i < n; i++) {
+      float d = delay.Read() * dmix;
+      float scale = 1.0f / (1.0f + dmix);
+      mono[i] = (mono[i] + d) * scale;
+      left[i] = (left[i] + d) * scale;
+      right[i] = (right[i] + d) * scale;
+      delay.Write(mono[i]);
+    }
+
+    switch(reverb_tier) {
+      case ReverbTier::off:
+        std::copy(left, left + n, wet_l);
+        std::copy(right, right + n, wet_r);
+        break;
+      case ReverbTier::sc:
+        for(size_t i = 0; i < n; i++) {
+          reverb->Process(mono[i], mono[i], &wet_l[i], &wet_r[i]);
+          // Apply gain after reverb processing because rvb feedback makes it
+          // very loud
+          wet_l[i] *= reverb_gain;
+          wet_r[i] *= reverb_gain;
+        }
+        break;
+      default:
+        fdn.Process(mono, wet_l, wet_r, n);
+        break;
+    }
+
+    for(size_t i = 0; i < n; i++) {
+      out[2 * i] = wet_l[i] * reverb_wet + left[i] * (1 - reverb_wet);
+      out[2 * i + 1] = wet_r[i] * reverb_wet + right[i] * (1 - reverb_wet);
+    }
+  }
+
+  void set_reverb_tier(ReverbTier tier) {
+    LogPrint("Reverb tier -> %i\n", static_cast<int>(tier));
+    switch(tier) {
+      case ReverbTier::fdn4: fdn.set_lines(4); break;
+      case ReverbTier::fdn8: fdn.set_lines(8); break;
+      case ReverbTier::fdn16: fdn.set_lines(16); break;
+      default: break;
+    }
+    reverb_tier = tier;
+  }
+  ReverbTier get_reverb_tier() { return reverb_tier; }
+
+  void set_delay_time(float val) {
+    LogPrint("Control Received: Delay Delay -> 0.%03i\n", static_cast<int>(1000 * val));
+    delay.set_delay(val);
+  }
+  void set_delay_sync(uint8_t division) {
+    LogPrint("Control Received: Delay Sync -> %s\n", delay_division_names[division % delay_divisions.size()]);
+    delay.set_division(division);
+  }
+  uint8_t get_delay_sync() { return delay.get_division(); }
+  // Sequencer step length for the synced delay times
+  void set_delay_step(float secs) { delay.set_step_secs(secs); }
+  void set_delay_damp_freq(float freq) {
+    LogPrint("Control Received: Delay Damp -> %i\n", static_cast<int>(freq));
+    delay.set_damp_freq(freq);
+  }
+  void set_delay_mix(float val) {
+    LogPrint("Control Received: Delay Mix -> 0.%03i\n", static_cast<int>(1000 * val));
+    delay_mix = val;
+  }
+  void set_reverb_damp_freq(float val) {
+    static daisy::MappedFloatValue rv_freq_map{
+      100, samplerate / 3  + 1, 440,
+        daisy::MappedFloatValue::Mapping::log, "Hz"};
+    rv_freq_map.SetFrom0to1(val);
+    LogPrint("Control Received: Reverb Freq -> 0.%03i\n", static_cast<int>(1000 * rv_freq_map.Get()));
+    reverb->SetLpFreq(val);
+  }
+  void set_reverb_feedback(float val) {
+    LogPrint("Control Received: Reverb Feedback -> 0.%03i\n", static_cast<int>(1000 * val));
+    reverb->SetFeedback(val);
+    fdn.set_feedback(val);
+  }
+  void set_reverb_wet(float val) {
+    LogPrint("Control Received: Reverb wet -> 0.%03i\n", static_cast<int>(1000 * val));
+    reverb_wet = val;
+  }
+};
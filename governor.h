@@ -0,0 +1,147 @@
+#pragma once
+#include "daisy_pod.h"
+#include <util/CpuLoadMeter.h>
+#include <cstdio>
+
+#include "fx.h"
+#include "part.h"
+#include "player.h"
+
+#ifdef USB_MIDI
+// The USB port is MIDI, there's no serial log to print to
+#define LogPrint(...)
+#else
+#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+//#define LogPrint(...)
+#endif
+
+// Watches the audio callback load and trades quality for headroom before
+// it overruns. Each level is one more step down, always in this order:
+//   1. lower the global voice budget (voices are stolen from the busiest part)
+//   2. lower the reverb tier, down to fdn4
+//   3. raise the control rate divisor, up to 8
+// Levels come back one at a time once the load has stayed low for a while.
+class Governor {
+  public:
+  static constexpr uint32_t interval_ms{100};
+  static constexpr float high{0.90}; // max load that triggers a step down
+  static constexpr float low{0.60};  // max load that allows a step up
+  static constexpr uint8_t restore_after{20}; // quiet intervals before stepping up
+
+  private:
+  daisy::CpuLoadMeter meter;
+  FxBus* fx{nullptr};
+  VoiceBudget* budget{nullptr};
+  Part* parts{nullptr};
+  size_t num_parts{0};
+  uint32_t last_t{0};
+  uint8_t quiet{0};
+
+  uint8_t level{0};
+  uint8_t voice_levels{0};
+  uint8_t reverb_levels{0};
+  static constexpr uint8_t div_levels{3};
+  ReverbTier base_tier{ReverbTier::sc};
+
+  int load{0}; // percent, for display
+
+  public:
+  void init(float samplerate, size_t block_size, FxBus& bus, VoiceBudget& voices, Part* p, size_t n) {
+    meter.Init(samplerate, block_size);
+    fx = &bus;
+    budget = &voices;
+    parts = p;
+    num_parts = n;
+    voice_levels = budget->get_max() - 1;
+    base_tier = fx->get_reverb_tier();
+    reverb_levels = base_tier > ReverbTier::fdn4
+      ? static_cast<uint8_t>(base_tier) - static_cast<uint8_t>(ReverbTier::fdn4) : 0;
+  }
+
+  // Audio callback side
+  void block_start() { meter.OnBlockStart(); }
+  void block_end() { meter.OnBlockEnd(); }
+
+  // Main loop side, with the audio callback held off as it changes the
+  // budget and reverb. Returns true when the level changed.
+  bool update(uint32_t now) {
+    if(now < last_t + interval_ms)
+      return false;
+    last_t = now;
+
+    float max_load = meter.GetMaxCpuLoad();
+    load = static_cast<int>(100 * max_load);
+    meter.Reset();
+
+    uint8_t new_level = level;
+    if(max_load > high) {
+      quiet = 0;
+      if(level < max_level())
+        new_level++;
+    }
+    else if(max_load < low) {
+      if(quiet < restore_after)
+        quiet++;
+      if(quiet >= restore_after && level > 0) {
+        new_level--;
+        quiet = 0;
+      }
+    }
+    else
+      quiet = 0;
+
+    if(new_level == level)
+      return false;
+    level = new_level;
+    apply();
+    return true;
+  }
+
+  // Main loop, outside the blocker update() runs in
+  void log() {
+    LogPrint("Governor: load %i%% -> level %u (voices %u, reverb %u, ctrl div %u)\n",
+        load, level, voices(), static_cast<unsigned>(tier()), control_div());
+  }
+
+  uint8_t get_level() { return level; }
+  // For replaying a recorded session
+  void set_level(uint8_t l) {
+    level = std::min(l, max_level());
+    apply();
+  }
+
+  int get_load() { return load; }
+
+  void status(char* out) {
+    std::sprintf(out, "CPU %i%% Q-%u", load, level);
+  }
+
+  private:
+  uint8_t max_level() { return voice_levels + reverb_levels + div_levels; }
+
+  uint8_t voices() {
+    uint8_t drop = std::min(level, voice_levels);
+    return budget->get_max() - drop;
+  }
+
+  ReverbTier tier() {
+    if(level <= voice_levels)
+      return base_tier;
+    uint8_t drop = std::min<uint8_t>(level - voice_levels, reverb_levels);
+    return static_cast<ReverbTier>(static_cast<uint8_t>(base_tier) - drop);
+  }
+
+  uint8_t control_div() {
+    if(level <= voice_levels + reverb_levels)
+      return 1;
+    return 1 << (level - voice_levels - reverb_levels);
+  }
+
+  void apply() {
+    budget->set_limit(voices());
+    if(fx->get_reverb_tier() != tier())
+      fx->set_reverb_tier(tier());
+    for(size_t i = 0; i < num_parts; i++)
+      parts[i].player.set_control_div(control_div());
+  }
+};
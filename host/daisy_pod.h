@@ -0,0 +1,225 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Just enough of libDaisy for the synth headers to build on a PC, for the
+// host tools. Nothing here touches hardware: there's no log, no IRQs,
+// the Pod's knobs and buttons never move and SDRAM is ordinary memory.
+// DaisySP is the real one, built from DAISYSP_DIR (see host/Makefile).
+
+#define DSY_SDRAM_BSS
+#define DSY_GPIOB 1
+
+namespace daisy {
+
+enum MidiMessageType {
+  NoteOff,
+  NoteOn,
+  PolyphonicKeyPressure,
+  ControlChange,
+  ProgramChange,
+  ChannelPressure,
+  PitchBend,
+  SystemCommon,
+  SystemRealTime,
+  ChannelMode,
+  MessageLast,
+};
+
+enum SystemCommonType {
+  SystemExclusive,
+  MTCQuarterFrame,
+  SongPositionPointer,
+  SongSelect,
+  SCUndefined0,
+  SCUndefined1,
+  TuneRequest,
+  SysExEnd,
+  SystemCommonLast,
+};
+
+struct NoteOnEvent {
+  int channel;
+  uint8_t note;
+  uint8_t velocity;
+};
+
+struct NoteOffEvent {
+  int channel;
+  uint8_t note;
+  uint8_t velocity;
+};
+
+struct ControlChangeEvent {
+  int channel;
+  uint8_t control_number;
+  uint8_t value;
+};
+
+#define SYSEX_BUFFER_LEN 128
+
+struct MidiEvent {
+  MidiMessageType type;
+  int channel;
+  uint8_t data[2];
+  SystemCommonType sc_type;
+  uint8_t sysex_data[SYSEX_BUFFER_LEN];
+  uint8_t sysex_message_len;
+
+  NoteOnEvent AsNoteOn() { return {channel, data[0], data[1]}; }
+  NoteOffEvent AsNoteOff() { return {channel, data[0], data[1]}; }
+  ControlChangeEvent AsControlChange() { return {channel, data[0], data[1]}; }
+};
+
+// libDaisy's parser cut down to what the host tools send it: channel
+// messages with running status, real time bytes and SysEx
+class MidiParser {
+  uint8_t status{0};
+  uint8_t data[2]{};
+  uint8_t n{0};
+  bool in_sysex{false};
+  MidiEvent sysex{};
+
+  public:
+  void Init() { Reset(); }
+  void Reset() {
+    status = 0;
+    n = 0;
+    in_sysex = false;
+  }
+
+  bool Parse(uint8_t byte, MidiEvent* out) {
+    if(byte >= 0xF8) {
+      *out = MidiEvent{};
+      out->type = SystemRealTime;
+      return true;
+    }
+    if(in_sysex && byte < 0x80) {
+      if(sysex.sysex_message_len < SYSEX_BUFFER_LEN)
+        sysex.sysex_data[sysex.sysex_message_len++] = byte;
+      return false;
+    }
+    if(in_sysex && byte == 0xF7) {
+      in_sysex = false;
+      *out = sysex;
+      return true;
+    }
+    if(byte & 0x80) {
+      in_sysex = byte == 0xF0;
+      sysex = MidiEvent{};
+      sysex.type = SystemCommon;
+      sysex.sc_type = SystemExclusive;
+      status = byte < 0xF0 ? byte : 0;
+      n = 0;
+      return false;
+    }
+    if(!status)
+      return false;
+    data[n++] = byte;
+    auto type = static_cast<MidiMessageType>((status >> 4) & 7);
+    uint8_t len = type == ProgramChange || type == ChannelPressure ? 1 : 2;
+    if(n < len)
+      return false;
+    n = 0;
+    *out = MidiEvent{};
+    out->type = type == ControlChange && data[0] >= 120 ? ChannelMode : type;
+    out->channel = status & 0x0F;
+    out->data[0] = data[0];
+    out->data[1] = len > 1 ? data[1] : 0;
+    return true;
+  }
+};
+
+struct AudioHandle {
+  typedef const float* InterleavingInputBuffer;
+  typedef float* InterleavingOutputBuffer;
+};
+
+struct System {
+  static uint32_t GetNow() { return 0; }
+  static uint32_t GetUs() { return 0; }
+  static void Delay(uint32_t) {}
+  static void DelayUs(uint32_t) {}
+};
+
+// Single threaded, there's nothing to hold off
+struct ScopedIrqBlocker {
+  ScopedIrqBlocker() {}
+  ~ScopedIrqBlocker() {}
+};
+
+struct DaisySeed {
+  // The Pod prints over the USB serial log, the host tools keep quiet
+  static void Print(const char*, ...) {}
+};
+
+struct Color {
+  void Init(float, float, float) {}
+};
+
+struct AnalogControl {
+  float Process() { return 0; }
+  float Value() { return 0; }
+};
+
+struct Parameter {
+  enum Curve { LINEAR, EXPONENTIAL, LOGARITHMIC, CUBE };
+  float min{0};
+  void Init(AnalogControl, float lo, float, Curve) { min = lo; }
+  float Process() { return min; }
+  float Value() { return min; }
+};
+
+struct Encoder {
+  int32_t Increment() { return 0; }
+  bool RisingEdge() { return false; }
+  bool FallingEdge() { return false; }
+  bool Pressed() { return false; }
+  float TimeHeldMs() { return 0; }
+};
+
+struct Switch {
+  bool RisingEdge() { return false; }
+  bool FallingEdge() { return false; }
+  bool Pressed() { return false; }
+};
+
+// MIDI out goes nowhere
+struct MidiUartHandler {
+  void SendMessage(uint8_t*, size_t) {}
+};
+
+struct DaisyPod {
+  AnalogControl knob1, knob2;
+  Encoder encoder;
+  Switch button1, button2;
+  MidiUartHandler midi;
+
+  void ProcessDigitalControls() {}
+  void ProcessAnalogControls() {}
+};
+
+// The LCD's I2C, every transfer succeeds
+struct I2CHandle {
+  struct Config {
+    enum class Peripheral { I2C_1 };
+    enum class Speed { I2C_100KHZ };
+    enum class Mode { I2C_MASTER };
+    struct Pin {
+      int port;
+      uint8_t pin;
+    };
+    Peripheral periph;
+    struct {
+      Pin scl;
+      Pin sda;
+    } pin_config;
+    Speed speed;
+    Mode mode;
+  };
+  enum class Result { OK, ERR };
+  Result Init(const Config&) { return Result::OK; }
+  Result TransmitBlocking(uint16_t, uint8_t*, uint16_t, uint32_t) { return Result::OK; }
+};
+
+} // namespace daisy
@@ -0,0 +1,453 @@
+// Golden audio check, run on a PC. Renders the scenario scripts through
+// the same Part / Player / FxBus code as the Pod and compares each render
+// with its reference WAV by RMS and by spectrum, then reports how fast it
+// rendered. See host/Makefile and the README.
+//
+//   golden [--update] [--summary label] [--ref dir] [--out dir] [--rms-db x] [--band-db x] script...
+//
+// --summary prints one line for all the scripts instead of one each, for
+// the build profile table.
+//
+// A script is one event a line, "<seconds> <command> args", # comments:
+//
+//   part <n>                 later lines go to part n (0 or 1)
+//   cc <control> <0-127>     a control from control_descs, by name
+//   tempo <secs>             Seq::set_tempo
+//   arp_mode <name>          asis, asc, desc, pingpong, random, updown_incl, updown_excl
+//   detune <0-1>             Pod knob 1
+//   delay_sync <division>    0 free, 1 - 10 see delay_divisions
+//   reverb_tier <0-4>        ReverbTier
+//   step <arp|single> notes...        adds a sequencer step, at 0 only
+//   step chord <strum samples> notes...
+//   lock <control> <0-127>   parameter lock on the last step added
+//   pause                    stops the sequencer, for notes played directly
+//   note <n> [velocity]      Player::play_note
+//   chord <notes...>         Player::play_chord
+//   rest                     Player::play_rest
+//   end                      the render stops here
+
+#include "daisy_pod.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "part.h"
+#include "render.h"
+#include "sampler.h"
+
+#define CONTROL(name) {#name, SynthControl::name}
+constexpr std::pair<const char*, SynthControl> control_names[]{
+  CONTROL(wave_shape), CONTROL(vcf_cutoff), CONTROL(vcf_resonance), CONTROL(vcf_envelope_depth),
+  CONTROL(envelope_a_vca), CONTROL(envelope_d_vca), CONTROL(envelope_a_vcf), CONTROL(envelope_d_vcf),
+  CONTROL(arp_note_length), CONTROL(delay_time), CONTROL(delay_mix), CONTROL(delay_damp),
+  CONTROL(reverb_feedback), CONTROL(reverb_damp_freq), CONTROL(reverb_wet),
+  CONTROL(lfo1_rate), CONTROL(lfo1_cutoff), CONTROL(lfo2_rate), CONTROL(lfo2_pan),
+  CONTROL(lfo1_shape), CONTROL(lfo2_shape), CONTROL(lfo1_delay_mix), CONTROL(lfo2_detune),
+  CONTROL(tuning_scale), CONTROL(tuning_root), CONTROL(midi_out_notes), CONTROL(midi_out_clock),
+  CONTROL(midi_in_filter), CONTROL(sample_select), CONTROL(input_mode), CONTROL(input_gate),
+  CONTROL(unison_voices), CONTROL(unison_spread), CONTROL(drive), CONTROL(drive_oversample),
+  CONTROL(humanize_velocity), CONTROL(humanize_time), CONTROL(arp_skip),
+  CONTROL(arp_octaves), CONTROL(euclid_steps), CONTROL(euclid_hits), CONTROL(euclid_rotate),
+  CONTROL(arp_ratchet), CONTROL(arp_ratchet_every),
+};
+#undef CONTROL
+
+constexpr const char* arp_mode_names[]{"asis", "asc", "desc", "pingpong", "random", "updown_incl", "updown_excl"};
+static_assert(std::size(arp_mode_names) == static_cast<size_t>(ArpMode::Count));
+
+// Everything main() sets up, fresh for each script
+struct Synth {
+  Bus fx{samplerate};
+  VoiceBudget budget;
+  PatternBank* bank{new(bank_heap) PatternBank()};
+  Part parts[num_parts]{
+    {samplerate, 0, *bank, fx, budget},
+    {samplerate, 1, *bank, fx, budget}};
+  size_t steps_added[num_parts]{};
+};
+
+struct Script {
+  struct Line {
+    uint32_t frame;
+    std::vector<std::string> words;
+    int number;
+  };
+  std::string name;
+  std::vector<Line> lines;
+  uint32_t frames{0};
+};
+
+static bool load_script(const char* path, Script& s) {
+  FILE* f = std::fopen(path, "r");
+  if(!f) {
+    std::fprintf(stderr, "%s: can't open\n", path);
+    return false;
+  }
+  std::string base = path;
+  base = base.substr(base.find_last_of('/') + 1);
+  s.name = base.substr(0, base.find_last_of('.'));
+  char buf[512];
+  int number = 0;
+  bool ok = true;
+  while(std::fgets(buf, sizeof(buf), f)) {
+    number++;
+    if(char* hash = std::strchr(buf, '#'))
+      *hash = 0;
+    std::vector<std::string> words;
+    for(char* w = std::strtok(buf, " \t\r\n"); w; w = std::strtok(nullptr, " \t\r\n"))
+      words.push_back(w);
+    if(words.empty())
+      continue;
+    char* end;
+    double secs = std::strtod(words[0].c_str(), &end);
+    if(*end || secs < 0 || words.size() < 2) {
+      std::fprintf(stderr, "%s:%d: expected <seconds> <command>\n", path, number);
+      ok = false;
+      continue;
+    }
+    uint32_t frame = static_cast<uint32_t>(std::lround(secs * samplerate));
+    words.erase(words.begin());
+    if(words[0] == "end")
+      s.frames = frame;
+    else
+      s.lines.push_back({frame, words, number});
+  }
+  std::fclose(f);
+  std::stable_sort(s.lines.begin(), s.lines.end(), [](const Script::Line& a, const Script::Line& b) { return a.frame < b.frame; });
+  if(s.frames == 0) {
+    std::fprintf(stderr, "%s: no end\n", path);
+    ok = false;
+  }
+  return ok;
+}
+
+static bool find_control(const std::string& name, SynthControl& c) {
+  for(const auto& [n, control] : control_names)
+    if(name == n) {
+      c = control;
+      return true;
+    }
+  return false;
+}
+
+static int to_int(const std::string& w) { return std::atoi(w.c_str()); }
+
+// Applies one script line to the synth the way the Controller would
+static bool apply(Synth& synth, size_t& current, const Script::Line& line, const std::string& name) {
+  const std::vector<std::string>& w = line.words;
+  Part& part = synth.parts[current];
+  const std::string& cmd = w[0];
+  auto args = [&](size_t n) { return w.size() >= n + 1; };
+
+  if(cmd == "part" && args(1) && to_int(w[1]) >= 0 && to_int(w[1]) < static_cast<int>(num_parts))
+    current = to_int(w[1]);
+  else if((cmd == "cc" || cmd == "lock") && args(2)) {
+    SynthControl c;
+    if(!find_control(w[1], c)) {
+      std::fprintf(stderr, "%s:%d: no control %s\n", name.c_str(), line.number, w[1].c_str());
+      return false;
+    }
+    uint8_t v = static_cast<uint8_t>(std::clamp(to_int(w[2]), 0, 127));
+    if(cmd == "lock")
+      part.seq.get_step().lock(static_cast<uint8_t>(c), v);
+    else {
+      part.patch[c] = v;
+      control_desc(c).apply(part.player, part.arp, v);
+    }
+  }
+  else if(cmd == "tempo" && args(1))
+    part.seq.set_tempo(std::atof(w[1].c_str()));
+  else if(cmd == "arp_mode" && args(1)) {
+    auto m = std::find_if(std::begin(arp_mode_names), std::end(arp_mode_names), [&](const char* n) { return w[1] == n; });
+    if(m == std::end(arp_mode_names)) {
+      std::fprintf(stderr, "%s:%d: no arp mode %s\n", name.c_str(), line.number, w[1].c_str());
+      return false;
+    }
+    part.arp.set_mode(static_cast<ArpMode>(m - std::begin(arp_mode_names)));
+  }
+  else if(cmd == "detune" && args(1))
+    part.player.set_detune(std::atof(w[1].c_str()));
+  else if(cmd == "delay_sync" && args(1))
+    part.player.set_delay_sync(static_cast<uint8_t>(to_int(w[1])));
+  else if(cmd == "reverb_tier" && args(1))
+    synth.fx.set_reverb_tier(static_cast<ReverbTier>(std::clamp(to_int(w[1]), 0, static_cast<int>(ReverbTier::Count) - 1)));
+  else if(cmd == "step" && args(1)) {
+    // The Seq starts with one empty step, the first script step fills it.
+    // The Seq is left on the last step so the first update plays step 0.
+    Seq& seq = part.seq;
+    if(synth.steps_added[current]++ > 0) {
+      seq.add_step();
+      seq.next_step();
+    }
+    Step& step = seq.get_step();
+    size_t first = 2;
+    if(w[1] == "chord" && args(2)) {
+      step.mode = StepMode::chord;
+      step.strum = static_cast<uint16_t>(to_int(w[2]));
+      first = 3;
+    }
+    else if(w[1] == "single")
+      step.mode = StepMode::single;
+    else if(w[1] != "arp") {
+      std::fprintf(stderr, "%s:%d: step mode %s\n", name.c_str(), line.number, w[1].c_str());
+      return false;
+    }
+    for(size_t i = first; i < w.size(); i++)
+      seq.push_note(static_cast<uint8_t>(to_int(w[i])));
+  }
+  else if(cmd == "pause")
+    part.seq.pause();
+  else if(cmd == "note" && args(1)) {
+    daisy::NoteOnEvent n{0, static_cast<uint8_t>(to_int(w[1])), static_cast<uint8_t>(args(2) ? to_int(w[2]) : 127)};
+    part.player.play_note(n);
+  }
+  else if(cmd == "chord" && args(1)) {
+    std::vector<uint8_t> keys;
+    for(size_t i = 1; i < w.size(); i++)
+      keys.push_back(static_cast<uint8_t>(to_int(w[i])));
+    part.player.play_chord(keys);
+  }
+  else if(cmd == "rest")
+    part.player.play_rest();
+  else {
+    std::fprintf(stderr, "%s:%d: can't read %s\n", name.c_str(), line.number, cmd.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Interleaved stereo. Returns the seconds it took, not counting set up.
+static double render(const Script& script, std::vector<float>& out, bool& ok) {
+  // The shared state main() would have fresh from boot
+  rng.seed(0);
+  tuning = Tuning{};
+  auto synth = std::make_unique<Synth>();
+
+  out.assign(2 * static_cast<size_t>(script.frames), 0.0f);
+  std::vector<float> in(2 * block, 0.0f);
+  size_t current = 0;
+  size_t next = 0;
+  ok = true;
+  auto start = std::chrono::steady_clock::now();
+  for(uint32_t frame = 0; frame + block <= script.frames; frame += block) {
+    // Main loop: events, then the arp and sequencer updates
+    while(next < script.lines.size() && script.lines[next].frame <= frame)
+      ok &= apply(*synth, current, script.lines[next++], script.name);
+    for(Part& part : synth->parts) {
+      part.arp.update(part.player);
+      part.seq.update(part.player, part.arp, part.patch);
+    }
+    // Audio callback
+    render_parts(synth->parts, synth->fx, in.data(), out.data() + 2 * frame, block);
+    midi_out.drain([](uint8_t*, size_t) {});
+  }
+  std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+  return took.count();
+}
+
+static void fft(std::vector<std::complex<float>>& x) {
+  const size_t n = x.size();
+  for(size_t i = 1, j = 0; i < n; i++) {
+    size_t bit = n >> 1;
+    for(; j & bit; bit >>= 1)
+      j ^= bit;
+    j ^= bit;
+    if(i < j)
+      std::swap(x[i], x[j]);
+  }
+  for(size_t len = 2; len <= n; len <<= 1) {
+    std::complex<float> w = std::polar(1.0f, static_cast<float>(-2 * tables::pi / len));
+    for(size_t i = 0; i < n; i += len) {
+      std::complex<float> wk{1};
+      for(size_t k = 0; k < len / 2; k++) {
+        std::complex<float> a = x[i + k], b = x[i + k + len / 2] * wk;
+        x[i + k] = a + b;
+        x[i + k + len / 2] = a - b;
+        wk *= w;
+      }
+    }
+  }
+}
+
+// Power in third octave bands, 25Hz - 20kHz, of the mid channel averaged
+// over the whole render, in dB
+constexpr size_t fft_size{2048};
+static std::vector<std::pair<float, float>> band_levels(const std::vector<float>& audio) {
+  const size_t frames = audio.size() / 2;
+  std::vector<double> power(fft_size / 2 + 1, 0.0);
+  std::vector<std::complex<float>> x(fft_size);
+  size_t windows = 0;
+  for(size_t start = 0; start + fft_size <= frames; start += fft_size / 2, windows++) {
+    for(size_t i = 0; i < fft_size; i++) {
+      float hann = 0.5f - 0.5f * std::cos(static_cast<float>(2 * tables::pi * i / fft_size));
+      x[i] = 0.5f * (audio[2 * (start + i)] + audio[2 * (start + i) + 1]) * hann;
+    }
+    fft(x);
+    for(size_t k = 0; k < power.size(); k++)
+      power[k] += std::norm(x[k]);
+  }
+  std::vector<std::pair<float, float>> bands;
+  for(int b = -16; b <= 13; b++) {
+    float centre = 1000.0f * std::exp2(b / 3.0f);
+    float lo = centre * std::exp2(-1.0f / 6), hi = centre * std::exp2(1.0f / 6);
+    double sum = 0;
+    for(size_t k = 0; k < power.size(); k++) {
+      float hz = k * samplerate / fft_size;
+      if(hz >= lo && hz < hi)
+        sum += power[k];
+    }
+    float db = static_cast<float>(10 * std::log10(sum / std::max<size_t>(windows, 1) + 1e-20));
+    bands.push_back({centre, db});
+  }
+  return bands;
+}
+
+struct Delta {
+  float rms_db;  // difference against the reference's level
+  float band_db; // worst third octave band
+  float band_hz;
+};
+
+// Bands more than band_floor below the loudest one in the reference are
+// left out, their level is mostly noise
+constexpr float band_floor{60};
+static Delta compare(const std::vector<float>& render, const std::vector<float>& ref) {
+  // Both as the WAV would hold them
+  std::vector<float> audio(render.size());
+  for(size_t i = 0; i < render.size(); i++)
+    audio[i] = to_pcm(render[i]) / 32767.0f;
+  double diff = 0, level = 0;
+  for(size_t i = 0; i < ref.size(); i++) {
+    diff += (audio[i] - ref[i]) * (audio[i] - ref[i]);
+    level += ref[i] * ref[i];
+  }
+  Delta d{-200, 0, 0};
+  if(diff > 0)
+    d.rms_db = static_cast<float>(10 * std::log10(diff / std::max(level, 1e-20)));
+  auto a = band_levels(audio);
+  auto r = band_levels(ref);
+  float loudest = -200;
+  for(auto& [hz, db] : r)
+    loudest = std::max(loudest, db);
+  for(size_t b = 0; b < r.size(); b++) {
+    if(r[b].second < loudest - band_floor)
+      continue;
+    float e = std::fabs(a[b].second - r[b].second);
+    if(e > d.band_db) {
+      d.band_db = e;
+      d.band_hz = r[b].first;
+    }
+  }
+  return d;
+}
+
+int main(int argc, char** argv) {
+  bool update = false;
+  const char* summary = nullptr;
+  std::string ref_dir = "golden";
+  std::string out_dir = "build";
+  float rms_tol = -40; // dB
+  float band_tol = 1;  // dB
+  std::vector<const char*> paths;
+  for(int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if(a == "--update")
+      update = true;
+    else if(a == "--summary" && i + 1 < argc)
+      summary = argv[++i];
+    else if(a == "--ref" && i + 1 < argc)
+      ref_dir = argv[++i];
+    else if(a == "--out" && i + 1 < argc)
+      out_dir = argv[++i];
+    else if(a == "--rms-db" && i + 1 < argc)
+      rms_tol = std::atof(argv[++i]);
+    else if(a == "--band-db" && i + 1 < argc)
+      band_tol = std::atof(argv[++i]);
+    else if(a[0] == '-') {
+      std::fprintf(stderr, "usage: golden [--update] [--summary label] [--ref dir] [--out dir] [--rms-db x] [--band-db x] script...\n");
+      return 2;
+    }
+    else
+      paths.push_back(argv[i]);
+  }
+
+  // Only the summary line with --summary
+  auto row = [summary](const char* fmt, auto... args) {
+    if(!summary)
+      std::printf(fmt, args...);
+  };
+  row("%-16s %8s %16s %10s  %s\n", "scenario", "rms dB", "band dB (Hz)", "x realtime", "result");
+  int failed = 0, missing = 0;
+  double total_secs = 0, total_audio = 0;
+  Delta worst{-200, 0, 0};
+  for(const char* path : paths) {
+    Script script;
+    if(!load_script(path, script)) {
+      failed++;
+      continue;
+    }
+    std::vector<float> audio;
+    bool ok;
+    double secs = render(script, audio, ok);
+    double audio_secs = script.frames / samplerate;
+    total_secs += secs;
+    total_audio += audio_secs;
+    double speed = audio_secs / std::max(secs, 1e-9);
+
+    std::string out_path = out_dir + "/" + script.name + ".wav";
+    std::string ref_path = ref_dir + "/" + script.name + ".wav";
+    if(!write_wav(out_path, audio))
+      std::fprintf(stderr, "%s: can't write\n", out_path.c_str());
+    if(update) {
+      ok &= write_wav(ref_path, audio);
+      row("%-16s %8s %16s %10.1f  %s\n", script.name.c_str(), "", "", speed, ok ? "updated" : "FAILED");
+      failed += !ok;
+      continue;
+    }
+
+    std::vector<float> ref;
+    // Nothing to compare with isn't a failure, the references get made
+    // on purpose, see golden-update
+    if(!read_wav(ref_path, ref)) {
+      row("%-16s %8s %16s %10.1f  no reference, run make -C host golden-update\n", script.name.c_str(), "", "", speed);
+      missing++;
+      continue;
+    }
+    if(ref.size() != audio.size()) {
+      row("%-16s %8s %16s %10.1f  FAILED, %zu frames, reference has %zu\n", script.name.c_str(), "", "", speed, audio.size() / 2, ref.size() / 2);
+      failed++;
+      continue;
+    }
+    Delta d = compare(audio, ref);
+    worst.rms_db = std::max(worst.rms_db, d.rms_db);
+    worst.band_db = std::max(worst.band_db, d.band_db);
+    ok &= d.rms_db <= rms_tol && d.band_db <= band_tol;
+    char band[32];
+    std::snprintf(band, sizeof(band), "%.2f (%5.0f)", d.band_db, d.band_hz);
+    row("%-16s %8.1f %16s %10.1f  %s\n", script.name.c_str(), d.rms_db, band, speed, ok ? "ok" : "FAILED");
+    failed += !ok;
+  }
+  double speed = total_audio / std::max(total_secs, 1e-9);
+  if(summary) {
+    char result[48] = "ok";
+    if(failed)
+      std::snprintf(result, sizeof(result), "%d FAILED", failed);
+    else if(missing)
+      std::snprintf(result, sizeof(result), "%d no reference", missing);
+    std::printf("%-14s %10.1f %8.1f %8.2f  %s\n", summary, speed, worst.rms_db, worst.band_db, result);
+    return failed ? 1 : 0;
+  }
+  std::printf("\n%.1fs of audio in %.2fs, %.1fx realtime on this machine\n", total_audio, total_secs, speed);
+  if(failed)
+    std::printf("%d failed (tolerance %.0f dB RMS, %.1f dB per band)\n", failed, rms_tol, band_tol);
+  if(missing)
+    std::printf("%d without a reference, run make -C host golden-update to make them\n", missing);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,136 @@
+// Checks that MidiIn puts TRS and USB messages back in the order they
+// came in. Two StampedInputs on stand-in transports get bytes
+// interleaved at set times, a message split across receives, one that
+// arrives while the sources are being taken, and stamps that wrap. Run
+// on a PC, see host/Makefile.
+//
+//   midi_in_check
+
+#include "daisy_pod.h"
+#include <cstdio>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "midi_in.h"
+
+// What the Pod's transports do with received bytes: hand them to the
+// callback from StartRx
+struct FakeTransport {
+  struct Config {};
+  void (*callback)(uint8_t*, size_t, void*){nullptr};
+  void* context{nullptr};
+
+  void Init(Config) {}
+  void StartRx(void (*cb)(uint8_t*, size_t, void*), void* c) {
+    callback = cb;
+    context = c;
+  }
+  void receive(std::initializer_list<uint8_t> bytes) {
+    std::vector<uint8_t> b(bytes);
+    callback(b.data(), b.size(), context);
+  }
+};
+
+static uint32_t now{0};
+static uint32_t clock_now() { return now; }
+
+struct Inputs {
+  StampedInput<FakeTransport> trs;
+  StampedInput<FakeTransport> usb;
+  MidiIn midi_in;
+
+  Inputs() {
+    trs.Init({}, clock_now);
+    usb.Init({}, clock_now);
+    trs.start();
+    usb.start();
+  }
+
+  // The main loop's pass
+  void take(uint32_t cutoff) {
+    midi_in.take(trs, MidiSource::trs);
+    midi_in.take(usb, MidiSource::usb);
+    midi_in.merge(cutoff);
+  }
+
+  // "trs 20" for each event, in the order they come out
+  std::string order() {
+    std::string out;
+    MidiIn::Event e;
+    while(midi_in.pop(e)) {
+      char s[24];
+      std::snprintf(s, sizeof(s), "%s%s %u", out.empty() ? "" : ", ", e.source == MidiSource::trs ? "trs" : "usb", static_cast<unsigned>(e.stamp));
+      out += s;
+    }
+    return out;
+  }
+};
+
+static void receive(StampedInput<FakeTransport>& in, uint32_t t, std::initializer_list<uint8_t> bytes) {
+  now = t;
+  in.get_transport().receive(bytes);
+}
+
+static int failed = 0;
+
+static void expect(const char* what, const std::string& got, const char* want) {
+  bool ok = got == want;
+  std::printf("%-14s %s  %s\n", what, got.c_str(), ok ? "ok" : "FAILED");
+  if(!ok)
+    std::printf("%-14s %s  wanted\n", "", want);
+  failed += !ok;
+}
+
+int main() {
+  {
+    // Both inputs busy in one main loop pass. The CC's status byte comes
+    // in at 25 and the rest at 40, it's stamped when it's whole.
+    auto in = std::make_unique<Inputs>();
+    receive(in->usb, 10, {0x90, 60, 100});
+    receive(in->trs, 20, {0x90, 61, 100});
+    receive(in->trs, 25, {0xB0});
+    receive(in->usb, 30, {0x90, 62, 100});
+    receive(in->trs, 40, {74, 64});
+    receive(in->usb, 45, {0xF8});
+    in->take(50);
+    expect("interleaved", in->order(), "usb 10, trs 20, usb 30, trs 40, usb 45");
+  }
+  {
+    // The main loop reads the cutoff at 100 and takes TRS. Then TRS gets
+    // a message at 103 and USB one at 105, before USB is taken. Neither
+    // goes out until the next pass, and then TRS's goes first.
+    auto in = std::make_unique<Inputs>();
+    in->midi_in.take(in->trs, MidiSource::trs);
+    receive(in->trs, 103, {0x90, 60, 100});
+    receive(in->usb, 105, {0x90, 61, 100});
+    in->midi_in.take(in->usb, MidiSource::usb);
+    in->midi_in.merge(100);
+    expect("past cutoff", in->order(), "");
+    in->take(200);
+    expect("next pass", in->order(), "trs 103, usb 105");
+  }
+  {
+    // The microsecond clock wraps every 71 minutes
+    auto in = std::make_unique<Inputs>();
+    receive(in->trs, 0x10, {0x90, 60, 100});
+    receive(in->usb, 0xFFFFFFF0, {0x90, 61, 100});
+    in->take(0x20);
+    expect("clock wraps", in->order(), "usb 4294967280, trs 16");
+  }
+  {
+    // Running status, one status byte for three notes
+    auto in = std::make_unique<Inputs>();
+    receive(in->trs, 10, {0x90, 60, 100});
+    receive(in->usb, 15, {0x91, 60, 100});
+    receive(in->trs, 20, {61, 100, 62});
+    receive(in->trs, 30, {100});
+    in->take(40);
+    expect("running status", in->order(), "trs 10, usb 15, trs 20, trs 30");
+  }
+
+  if(failed)
+    std::printf("%d FAILED\n", failed);
+  return failed ? 1 : 0;
+}
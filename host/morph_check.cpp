@@ -0,0 +1,92 @@
+// Checks the snapshot controls and the morph between them, through the
+// same Controller code the Pod runs: takes A and B over MIDI with
+// different controls and arp modes, then moves the morph and checks the
+// part's patch and arp follow. Run on a PC, see host/Makefile.
+//
+//   morph_check
+
+#include "daisy_pod.h"
+#include <cstdio>
+#include <memory>
+
+#include "controller.h"
+#include "part.h"
+#include "recorder.h"
+#include "render.h"
+
+struct Session {
+  Bus fx{samplerate};
+  VoiceBudget budget;
+  PatternBank* bank{new(bank_heap) PatternBank()};
+  Part parts[num_parts]{
+    {samplerate, 0, *bank, fx, budget},
+    {samplerate, 1, *bank, fx, budget}};
+  LCD lcd;
+  daisy::DaisyPod pod;
+  Recorder recorder;
+  Controller controller{samplerate, parts, lcd, pod, recorder, *bank};
+};
+
+static void cc(Controller& c, uint8_t number, uint8_t value) {
+  daisy::MidiEvent m{};
+  m.type = daisy::ControlChange;
+  m.channel = 0;
+  m.data[0] = number;
+  m.data[1] = value;
+  c.HandleMidiMessage(m);
+}
+
+// Buttons send a press and a release
+static void press(Controller& c, uint8_t number) {
+  cc(c, number, 127);
+  cc(c, number, 0);
+}
+
+static int failed = 0;
+
+static void expect(const char* what, int got, int want) {
+  bool ok = got == want;
+  std::printf("%-28s %4d, want %4d  %s\n", what, got, want, ok ? "ok" : "FAILED");
+  failed += !ok;
+}
+
+int main() {
+  auto s = std::make_unique<Session>();
+  Controller& c = s->controller;
+  Part& p = s->parts[0];
+
+  cc(c, 71, 20);  // vcf_cutoff
+  cc(c, 74, 0);   // wave_shape
+  press(c, 105);  // snapshot_a
+  ArpMode mode_a = p.arp.get_mode();
+
+  cc(c, 71, 110);
+  cc(c, 74, 127);
+  press(c, 115);  // arp_mode, the next one
+  press(c, 106);  // snapshot_b
+  ArpMode mode_b = p.arp.get_mode();
+
+  // The cutoff, the shape and the arp mode
+  expect("controls that differ", p.morph.get_num_diff(), 3);
+
+  c.ApplyMorph(p, 0);
+  expect("A cutoff", p.patch[SynthControl::vcf_cutoff], 20);
+  expect("A shape", p.patch[SynthControl::wave_shape], 0);
+  expect("A arp mode", static_cast<int>(p.arp.get_mode()), static_cast<int>(mode_a));
+
+  c.ApplyMorph(p, 0.25f);
+  expect("quarter way cutoff", p.patch[SynthControl::vcf_cutoff], 43);
+  expect("quarter way shape", p.patch[SynthControl::wave_shape], 0);
+
+  c.ApplyMorph(p, 1);
+  expect("B cutoff", p.patch[SynthControl::vcf_cutoff], 110);
+  expect("B shape", p.patch[SynthControl::wave_shape], 127);
+  expect("B arp mode", static_cast<int>(p.arp.get_mode()), static_cast<int>(mode_b));
+
+  // The other part is left alone
+  expect("part 1 cutoff", s->parts[1].patch[SynthControl::vcf_cutoff], 127);
+
+  if(failed)
+    std::printf("%d FAILED\n", failed);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "daisy_pod.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "fx.h"
+#include "sampler.h"
+
+// What the host tools share: the Pod's audio settings and WAV files
+
+constexpr float samplerate{48000};
+constexpr size_t block{4}; // pod.SetAudioBlockSize(4), the Seq and Arp tick per block
+
+// The FxBus needs its samplerate before the Parts apply their defaults
+struct Bus : FxBus {
+  Bus(float sr) { Init(sr); }
+};
+
+// 16 bit stereo WAV, the same as the Pod's codec gives
+inline int16_t to_pcm(float x) {
+  return static_cast<int16_t>(std::lround(std::clamp(x, -1.0f, 1.0f) * 32767.0f));
+}
+
+inline bool write_wav(const std::string& path, const std::vector<float>& audio) {
+  FILE* f = std::fopen(path.c_str(), "wb");
+  if(!f)
+    return false;
+  auto le = [f](uint32_t v, int bytes) {
+    for(int i = 0; i < bytes; i++)
+      std::fputc((v >> (8 * i)) & 0xFF, f);
+  };
+  uint32_t data = static_cast<uint32_t>(audio.size() * 2);
+  std::fwrite("RIFF", 1, 4, f);
+  le(36 + data, 4);
+  std::fwrite("WAVEfmt ", 1, 8, f);
+  le(16, 4);
+  le(1, 2); // PCM
+  le(2, 2);
+  le(static_cast<uint32_t>(samplerate), 4);
+  le(static_cast<uint32_t>(samplerate) * 4, 4);
+  le(4, 2);
+  le(16, 2);
+  std::fwrite("data", 1, 4, f);
+  le(data, 4);
+  for(float x : audio)
+    le(static_cast<uint16_t>(to_pcm(x)), 2);
+  return std::fclose(f) == 0;
+}
+
+// Through the sampler's WAV parser, so a reference has to be a file the
+// Pod could play
+inline bool read_wav(const std::string& path, std::vector<float>& audio) {
+  HostSampleFile f;
+  SampleInfo info;
+  if(!f.open(path.c_str()) || !parse_wav(f, info) || info.channels != 2 || !f.seek(info.data_offset))
+    return false;
+  std::vector<int16_t> pcm(2 * static_cast<size_t>(info.frames));
+  if(f.read(pcm.data(), pcm.size() * 2) != pcm.size() * 2)
+    return false;
+  audio.resize(pcm.size());
+  for(size_t i = 0; i < pcm.size(); i++)
+    audio[i] = pcm[i] / 32767.0f;
+  return true;
+}
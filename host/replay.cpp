@@ -0,0 +1,142 @@
+// Runs an event log from Recorder::dump() back through the Controller,
+// Player and FxBus, the same code the Pod ran, and writes the audio as a
+// WAV. The log is replayed twice from a fresh synth and the two renders
+// have to match bit for bit. Run on a PC, see host/Makefile.
+//
+//   replay [--out file.wav] [--tail secs] log
+//
+// Save the serial log after holding the encoder down, anything in it that
+// isn't an event line is skipped. The log has to start from boot, one
+// that wrapped only replays the end of the session and won't sound the
+// same as the Pod did.
+
+#include "daisy_pod.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "controller.h"
+#include "governor.h"
+#include "part.h"
+#include "recorder.h"
+#include "render.h"
+
+// Everything main() sets up, fresh for each replay
+struct Session {
+  Bus fx{samplerate};
+  VoiceBudget budget;
+  PatternBank* bank{new(bank_heap) PatternBank()};
+  Part parts[num_parts]{
+    {samplerate, 0, *bank, fx, budget},
+    {samplerate, 1, *bank, fx, budget}};
+  LCD lcd;
+  daisy::DaisyPod pod;
+  Recorder recorder;
+  Governor governor;
+  Controller controller{samplerate, parts, lcd, pod, recorder, *bank};
+
+  Session() { governor.init(samplerate, block, fx, budget, parts, num_parts); }
+};
+
+static bool load_log(const char* path, std::vector<Event>& events, bool& wrapped) {
+  FILE* f = std::fopen(path, "r");
+  if(!f)
+    return false;
+  char line[256];
+  wrapped = false;
+  while(std::fgets(line, sizeof(line), f)) {
+    Event e;
+    if(Recorder::parse(line, e))
+      events.push_back(e);
+    else if(std::strstr(line, "# podsynth events") && std::strstr(line, "(wrapped)"))
+      wrapped = true;
+  }
+  std::fclose(f);
+  return true;
+}
+
+// Interleaved stereo, frames long
+static std::vector<float> render(const std::vector<Event>& events, uint32_t frames) {
+  // The shared state main() would have fresh from boot
+  rng.seed(0);
+  tuning = Tuning{};
+  auto s = std::make_unique<Session>();
+
+  std::vector<float> out(2 * static_cast<size_t>(frames), 0.0f);
+  std::vector<float> in(2 * block, 0.0f);
+  size_t pos = 0;
+  replay(
+    events.data(), events.size(), block, frames,
+    [&s](const Event& e) { s->controller.Replay(e, s->governor); },
+    [&](size_t n) {
+      render_parts(s->parts, s->fx, in.data(), out.data() + 2 * pos, n);
+      s->recorder.advance(n);
+      midi_out.drain([](uint8_t*, size_t) {});
+      pos += n;
+    });
+  return out;
+}
+
+int main(int argc, char** argv) {
+  std::string out_path;
+  float tail = 2;
+  const char* log_path = nullptr;
+  for(int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if(a == "--out" && i + 1 < argc)
+      out_path = argv[++i];
+    else if(a == "--tail" && i + 1 < argc)
+      tail = std::atof(argv[++i]);
+    else if(a[0] != '-' && !log_path)
+      log_path = argv[i];
+    else {
+      std::fprintf(stderr, "usage: replay [--out file.wav] [--tail secs] log\n");
+      return 2;
+    }
+  }
+  if(!log_path) {
+    std::fprintf(stderr, "usage: replay [--out file.wav] [--tail secs] log\n");
+    return 2;
+  }
+
+  std::vector<Event> events;
+  bool wrapped;
+  if(!load_log(log_path, events, wrapped)) {
+    std::fprintf(stderr, "%s: can't open\n", log_path);
+    return 1;
+  }
+  if(events.empty()) {
+    std::fprintf(stderr, "%s: no events\n", log_path);
+    return 1;
+  }
+  if(wrapped)
+    std::fprintf(stderr, "%s: the log wrapped, it doesn't start from boot\n", log_path);
+
+  // Whole blocks, past the last event to let the sound die away
+  uint32_t frames = events.back().sample + static_cast<uint32_t>(tail * samplerate);
+  frames -= frames % block;
+
+  std::vector<float> first = render(events, frames);
+  std::vector<float> second = render(events, frames);
+
+  if(out_path.empty()) {
+    std::string base = log_path;
+    base = base.substr(base.find_last_of('/') + 1);
+    out_path = "build/" + base.substr(0, base.find_last_of('.')) + ".wav";
+  }
+  if(!write_wav(out_path, first))
+    std::fprintf(stderr, "%s: can't write\n", out_path.c_str());
+
+  size_t differ = 0;
+  while(differ < first.size() && std::memcmp(&first[differ], &second[differ], sizeof(float)) == 0)
+    differ++;
+  std::printf("%s: %zu events, %.2fs -> %s\n", log_path, events.size(), frames / samplerate, out_path.c_str());
+  if(differ < first.size()) {
+    std::printf("replays differ from frame %zu\n", differ / 2);
+    return 1;
+  }
+  std::printf("replays match bit for bit\n");
+  return 0;
+}
@@ -0,0 +1,54 @@
+// Checks the lookups in tables.h against libm over their whole input
+// ranges and prints the worst error of each. The static_asserts in
+// tables.h only check them against the series the tables were built
+// from, and only over part of the range. Run on a PC, see host/Makefile.
+//
+//   table_check
+
+#include <cmath>
+#include <cstdio>
+
+#include "tables.h"
+
+static int failed = 0;
+
+// Steps through from - to, lookup takes the float the synth would pass
+// and exact gets the same value as a double
+template <typename F, typename G>
+static void check(const char* name, F lookup, G exact, double from, double to, bool relative, double max) {
+  constexpr int points = 1000000;
+  double worst = 0, worst_x = from;
+  for(int i = 0; i <= points; i++) {
+    float x = static_cast<float>(from + (to - from) * i / points);
+    double want = exact(static_cast<double>(x));
+    double e = std::fabs(lookup(x) - want);
+    if(relative)
+      e /= std::fabs(want);
+    if(e > worst) {
+      worst = e;
+      worst_x = x;
+    }
+  }
+  bool ok = worst <= max;
+  std::printf("%-14s %9g to %-9g worst %.3g%s at %g, %s\n", name, from, to, worst, relative ? " relative" : "", worst_x, ok ? "ok" : "FAILED");
+  failed += !ok;
+}
+
+int main() {
+  constexpr double two_pi = 2 * 3.14159265358979323846;
+  // Phases wrap, so a few cycles either side of 0
+  check("sin_cycle", tables::sin_cycle, [](double x) { return std::sin(two_pi * x); }, -4, 4, false, 1e-5);
+  // Every octave exp2 doesn't clamp
+  check("exp2", tables::exp2, [](double x) { return std::exp2(x); },
+        -tables::exp2_octave_max, tables::exp2_octave_max - 1e-3, true, 2e-6);
+  // Including the flat part past +-tanh_range
+  check("tanh", tables::tanh, [](double x) { return std::tanh(x); }, -3 * tables::tanh_range, 3 * tables::tanh_range, false, 1e-3);
+  // The controls pass fractional CCs when morphing
+  check("cc_env_secs", [](float cc) { return tables::cc_lookup(tables::cc_env_secs, cc); },
+        [](double cc) { return 0.007 + cc / 127.0; }, 0, 127, false, 1e-6);
+  check("cc_damp_freq", [](float cc) { return tables::cc_lookup(tables::cc_damp_freq, cc); },
+        [](double cc) { return 200 * std::exp2(cc / 127.0 * std::log2(80.0)); }, 0, 127, true, 2e-4);
+  if(failed)
+    std::printf("%d FAILED\n", failed);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,34 @@
+// Checks the 12-TET tuning table against daisysp::mtof, the powf the
+// table replaced, for every note and with the root on each note of an
+// octave. Run on a PC, see host/Makefile.
+//
+//   tuning_check [max cents]
+
+#include "daisy_pod.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "tuning.h"
+
+int main(int argc, char** argv) {
+  double max_cents = argc > 1 ? std::atof(argv[1]) : 0.01;
+  double worst = 0;
+  int worst_note = 0, worst_root = 0;
+  for(int root = 60; root < 72; root++) {
+    Tuning t;
+    t.set_root(static_cast<uint8_t>(root));
+    for(int note = 0; note < 128; note++) {
+      double want = daisysp::mtof(static_cast<float>(note));
+      double cents = std::fabs(1200 * std::log2(t.freq(static_cast<uint8_t>(note)) / want));
+      if(cents > worst) {
+        worst = cents;
+        worst_note = note;
+        worst_root = root;
+      }
+    }
+  }
+  bool ok = worst <= max_cents;
+  std::printf("12-TET against mtof: worst %.5f cents, note %d with the root on %d, %s\n", worst, worst_note, worst_root, ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+// How many voices fit in an audio callback with each unison stack size,
+// at each block size. Run on a PC, see host/Makefile. The times are the
+// PC's, the Pod is a lot slower: scale by the PC / Pod speed ratio of
+// something with a known cost on both (the CPU figure on the LCD) before
+// reading them as Pod numbers.
+//
+//   unison_bench [seconds per case]
+
+#include "daisy_pod.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "note.h"
+
+constexpr float samplerate{48000};
+constexpr size_t block_sizes[]{4, 8, 16, 32, 64};
+static_assert(Unison::max_block >= 64);
+
+// Seconds of CPU to render one voice for a second of audio
+static double voice_cost(size_t saws, size_t n, double seconds) {
+  Note note{samplerate};
+  note.set_vca_attack(0.01f);
+  note.set_vca_decay(1000.0f); // held for the whole run
+  note.unison.set_count(saws);
+  daisy::NoteOnEvent on{0, 45, 127};
+  note.note_on(on);
+
+  float l, r, sum = 0;
+  size_t blocks = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> took{};
+  while(took.count() < seconds) {
+    for(size_t b = 0; b < 256; b++, blocks++) {
+      note.prepare(n);
+      for(size_t i = 0; i < n; i++) {
+        note.process(0.5f, 0.2f, 0.0f, l, r);
+        sum += l + r;
+      }
+    }
+    took = std::chrono::steady_clock::now() - start;
+  }
+  // Keeps the render from being optimised away
+  if(sum == 12345.0f)
+    std::printf(" ");
+  return took.count() / (blocks * n / samplerate);
+}
+
+int main(int argc, char** argv) {
+  double seconds = argc > 1 ? std::atof(argv[1]) : 0.2;
+  std::printf("Voices that fit in the callback on this PC, one saw is the normal\n"
+              "two oscillator voice. %% is one voice's share of the callback.\n\n");
+  std::printf("%6s", "saws");
+  for(size_t n : block_sizes)
+    std::printf("  %6s %-7zu", "block", n);
+  std::printf("\n");
+  for(size_t saws = 1; saws <= Unison::max_voices; saws++) {
+    std::printf("%6zu", saws);
+    for(size_t n : block_sizes) {
+      double cost = voice_cost(saws, n, seconds);
+      std::printf("  %6.0f %6.3f%%", 1 / cost, 100 * cost);
+    }
+    std::printf("\n");
+  }
+  return 0;
+}
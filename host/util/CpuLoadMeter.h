@@ -0,0 +1,19 @@
+#pragma once
+#include <cstddef>
+
+// The governor's load meter, on the host the load always reads 0 so the
+// governor stays at level 0 unless a replayed log sets it
+namespace daisy {
+
+class CpuLoadMeter {
+  public:
+  void Init(float, size_t, float = 1.0f) {}
+  void OnBlockStart() {}
+  void OnBlockEnd() {}
+  float GetAvgCpuLoad() const { return 0; }
+  float GetMinCpuLoad() const { return 0; }
+  float GetMaxCpuLoad() const { return 0; }
+  void Reset() {}
+};
+
+} // namespace daisy
@@ -0,0 +1,35 @@
+#pragma once
+#include <cmath>
+
+// Host stand-in for libDaisy's MappedFloatValue, the linear and log
+// mappings the control descriptions print with.
+
+namespace daisy {
+
+class MappedFloatValue {
+  public:
+  enum class Mapping { lin, log, pow2 };
+
+  MappedFloatValue(float min, float max, float value, Mapping mapping = Mapping::lin, const char* = "", int = 0, bool = false)
+    : min(min)
+    , max(max)
+    , value(value)
+    , mapping(mapping) {}
+
+  void SetFrom0to1(float x) {
+    switch(mapping) {
+      case Mapping::log: value = min * std::pow(max / min, x); break;
+      case Mapping::pow2: value = min + (max - min) * x * x; break;
+      default: value = min + (max - min) * x; break;
+    }
+  }
+  float Get() const { return value; }
+
+  private:
+  float min;
+  float max;
+  float value;
+  Mapping mapping;
+};
+
+} // namespace daisy
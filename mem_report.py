@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""Per symbol memory report from a GNU ld map file.
+
+    python3 mem_report.py build/polysynth.map
+    python3 mem_report.py build/polysynth.map --expect ITCMRAM:Note::process
+    python3 mem_report.py build/polysynth.map --expect-section DTCMRAM:.dtcmram_bss
+
+Lists every input section with its size, region and the symbol it holds,
+biggest first, then how full each region is. --expect REGION:text fails
+(exit 1) unless a symbol containing text is in REGION, so a placement
+build can be checked from the map alone. --expect-section REGION:SECTION
+fails unless the output section SECTION is in REGION and not empty, for
+data that has no symbol in the map (function local statics).
+"""
+
+import argparse
+import re
+import shutil
+import subprocess
+import sys
+
+HEX = r"0x[0-9a-fA-F]+"
+
+
+def parse_regions(lines):
+    regions = []
+    in_table = False
+    for line in lines:
+        if line.startswith("Memory Configuration"):
+            in_table = True
+            continue
+        if in_table and line.startswith("Linker script and memory map"):
+            break
+        m = re.match(r"^(\w+)\s+(%s)\s+(%s)" % (HEX, HEX), line)
+        if in_table and m and m.group(1) != "Name":
+            regions.append((m.group(1), int(m.group(2), 16), int(m.group(3), 16)))
+    return regions
+
+
+def region_of(regions, addr):
+    for name, origin, length in regions:
+        if name != "default" and origin <= addr < origin + length:
+            return name
+    return "?"
+
+
+def parse_sections(lines):
+    """Yields [section, addr, size, object, symbols] for each input section."""
+    out = []
+    pending = None
+    current = None
+    started = False
+    for line in lines:
+        if line.startswith("Linker script and memory map"):
+            started = True
+            continue
+        if not started:
+            continue
+        # Input section on one line, or its name alone with the rest next
+        m = re.match(r"^ (\.\S+)\s+(%s)\s+(%s)\s+(\S+)" % (HEX, HEX), line)
+        if m:
+            current = [m.group(1), int(m.group(2), 16), int(m.group(3), 16), m.group(4), []]
+            out.append(current)
+            pending = None
+            continue
+        m = re.match(r"^ (\.\S+)\s*$", line)
+        if m:
+            pending = m.group(1)
+            continue
+        m = re.match(r"^\s+(%s)\s+(%s)\s+(\S+)" % (HEX, HEX), line)
+        if m and pending:
+            current = [pending, int(m.group(1), 16), int(m.group(2), 16), m.group(3), []]
+            out.append(current)
+            pending = None
+            continue
+        # Symbols inside the last input section
+        m = re.match(r"^\s{16}(%s)\s+(\S.*)$" % HEX, line)
+        if m and current and not m.group(2).startswith(("PROVIDE", ".")) and "=" not in m.group(2):
+            current[4].append(m.group(2).strip())
+    return [s for s in out if s[2] > 0]
+
+
+def parse_output_sections(lines):
+    """{name: (addr, size)} for each output section, the lines that start
+    in column 0."""
+    out = {}
+    pending = None
+    started = False
+    for line in lines:
+        if line.startswith("Linker script and memory map"):
+            started = True
+            continue
+        if not started:
+            continue
+        m = re.match(r"^(\.\S+)\s+(%s)\s+(%s)" % (HEX, HEX), line)
+        if m:
+            out[m.group(1)] = (int(m.group(2), 16), int(m.group(3), 16))
+            pending = None
+            continue
+        m = re.match(r"^(\.\S+)\s*$", line)
+        if m:
+            pending = m.group(1)
+            continue
+        m = re.match(r"^\s+(%s)\s+(%s)" % (HEX, HEX), line)
+        if m and pending:
+            out[pending] = (int(m.group(1), 16), int(m.group(2), 16))
+        pending = None
+    return out
+
+
+def demangle(names):
+    tool = shutil.which("arm-none-eabi-c++filt") or shutil.which("c++filt")
+    if not tool or not names:
+        return names
+    res = subprocess.run([tool], input="\n".join(names), capture_output=True, text=True)
+    out = res.stdout.splitlines()
+    return out if len(out) == len(names) else names
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("map")
+    ap.add_argument("--expect", action="append", default=[], metavar="REGION:TEXT")
+    ap.add_argument("--expect-section", action="append", default=[], metavar="REGION:SECTION")
+    ap.add_argument("--top", type=int, default=0, help="only the biggest n symbols")
+    args = ap.parse_args()
+
+    with open(args.map) as f:
+        lines = f.read().splitlines()
+    regions = parse_regions(lines)
+    sections = parse_sections(lines)
+
+    # A section with no symbols is reported by its own name, which for
+    # -ffunction-sections builds is the mangled function anyway
+    raw = []
+    for sec, addr, size, obj, syms in sections:
+        name = syms[0] if syms else re.sub(r"^\.(text|bss|data|rodata|itcmram|dtcmram_bss)\.", "", sec)
+        raw.append(name)
+    names = demangle(raw)
+
+    rows = []
+    for (sec, addr, size, obj, syms), name in zip(sections, names):
+        rows.append((size, region_of(regions, addr), addr, name, obj.split("/")[-1]))
+    rows.sort(key=lambda r: -r[0])
+
+    shown = rows[: args.top] if args.top else rows
+    print("%8s  %-10s %-10s  %-8s %s" % ("size", "region", "addr", "object", "symbol"))
+    for size, region, addr, name, obj in shown:
+        print("%8d  %-10s 0x%08x  %-8s %s" % (size, region, addr, obj[:8], name))
+
+    print()
+    print("%-10s %10s %10s %10s %6s" % ("region", "used", "size", "free", "used%"))
+    for name, origin, length in regions:
+        if name == "default":
+            continue
+        used = sum(r[0] for r in rows if r[1] == name)
+        print("%-10s %10d %10d %10d %5.1f%%" % (name, used, length, length - used, 100.0 * used / length))
+
+    failed = False
+    for e in args.expect:
+        region, text = e.split(":", 1)
+        hits = [r for r in rows if text in r[3]]
+        if not hits or any(r[1] != region for r in hits):
+            where = ", ".join(sorted({r[1] for r in hits})) or "nowhere"
+            print("expect %s in %s: found in %s" % (text, region, where), file=sys.stderr)
+            failed = True
+    outputs = parse_output_sections(lines)
+    for e in args.expect_section:
+        region, name = e.split(":", 1)
+        addr, size = outputs.get(name, (0, 0))
+        where = region_of(regions, addr) if name in outputs else "nowhere"
+        if size == 0 or where != region:
+            print("expect section %s in %s: %d bytes in %s" % (name, region, size, where), file=sys.stderr)
+            failed = True
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,226 @@
+#pragma once
+#include "daisy_pod.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+//#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+#define LogPrint(...)
+
+enum class MidiSource : uint8_t {
+  trs,
+  usb,
+  Count
+};
+
+// Wrap safe, for stamps from a free running clock
+inline bool stamped_before(uint32_t a, uint32_t b) { return static_cast<int32_t>(a - b) < 0; }
+
+// One MIDI input read straight off its transport (daisy::MidiUartTransport
+// or MidiUsbTransport) rather than through a MidiHandler, which parses in
+// the receive interrupt and keeps no time. Here the interrupt only stamps
+// the bytes from the clock as they come in and rings them, the main loop
+// parses them.
+//
+// One writer (the receive interrupt) and one reader (the main loop), the
+// same ring as MidiOut's.
+template <typename Transport>
+class StampedInput {
+  public:
+  typedef uint32_t (*Clock)();
+  static constexpr size_t ring_size{256}; // power of 2
+
+  private:
+  struct Byte {
+    uint8_t value;
+    uint32_t stamp;
+  };
+  Transport transport;
+  daisy::MidiParser parser;
+  Clock clock{nullptr};
+  std::array<Byte, ring_size> ring{};
+  std::atomic<uint32_t> head{0}; // written by the interrupt
+  std::atomic<uint32_t> tail{0}; // written by the main loop
+  uint32_t overruns{0};
+
+  // RECEIVE INTERRUPT, a whole DMA or USB packet at once
+  static void rx(uint8_t* data, size_t size, void* context) {
+    StampedInput& in = *static_cast<StampedInput*>(context);
+    uint32_t now = in.clock();
+    uint32_t h = in.head.load(std::memory_order_relaxed);
+    uint32_t t = in.tail.load(std::memory_order_acquire);
+    for(size_t i = 0; i < size; i++) {
+      if(h - t >= ring_size) {
+        in.overruns += size - i;
+        break;
+      }
+      in.ring[h++ % ring_size] = {data[i], now};
+    }
+    in.head.store(h, std::memory_order_release);
+  }
+
+  public:
+  void Init(const typename Transport::Config& config, Clock c) {
+    clock = c;
+    parser.Init();
+    transport.Init(config);
+  }
+  void start() { transport.StartRx(rx, this); }
+  Transport& get_transport() { return transport; }
+
+  // Main loop. The next whole message, stamped when its last byte came
+  // in. False once the ring is empty, a message that's only part way in
+  // stays in the parser for next time.
+  bool next(daisy::MidiEvent& m, uint32_t& stamp) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t h = head.load(std::memory_order_acquire);
+    while(t != h) {
+      Byte b = ring[t % ring_size];
+      tail.store(++t, std::memory_order_release);
+      if(parser.Parse(b.value, &m)) {
+        stamp = b.stamp;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  uint32_t get_overruns() { return overruns; }
+};
+
+// TRS and USB MIDI in, merged into one queue in the order the messages
+// came in. Each source's events wait in their own queue until every
+// source has been taken from past them (the cutoff, a time read before
+// taking from any of them), then the oldest go first. Everything is
+// handled a main loop pass after it arrives.
+//
+// Each source has a mask of the channels it lets through. System
+// messages (SysEx, clock) always get through.
+class MidiIn {
+  public:
+  static constexpr size_t queue_size{32};
+
+  struct Event {
+    daisy::MidiEvent m;
+    MidiSource source;
+    uint32_t stamp;
+  };
+
+  enum class Filter : uint8_t {
+    all,   // both, every channel
+    trs,   // TRS only
+    usb,   // USB only
+    split, // TRS plays part 1, USB part 2
+    Count
+  };
+
+  private:
+  struct Queue {
+    std::array<Event, queue_size> events;
+    size_t head{0};
+    size_t count{0};
+
+    bool push(const Event& e) {
+      if(count >= queue_size)
+        return false;
+      events[(head + count++) % queue_size] = e;
+      return true;
+    }
+    Event& front() { return events[head]; }
+    void pop() {
+      head = (head + 1) % queue_size;
+      count--;
+    }
+  };
+  std::array<Queue, static_cast<size_t>(MidiSource::Count)> pending;
+  Queue merged;
+  uint32_t dropped{0};
+  std::array<uint16_t, static_cast<size_t>(MidiSource::Count)> channels{0xFFFF, 0xFFFF};
+  Filter filter{Filter::all};
+  std::array<uint8_t, 2> split_channels{0, 1};
+
+  public:
+  void set_channels(MidiSource s, uint16_t mask) { channels[static_cast<size_t>(s)] = mask; }
+  uint16_t get_channels(MidiSource s) { return channels[static_cast<size_t>(s)]; }
+
+  // The parts' channels, for the split
+  void set_split(uint8_t part1, uint8_t part2) {
+    split_channels = {part1, part2};
+    set_filter(filter);
+  }
+
+  void set_filter(Filter f) {
+    filter = f;
+    uint16_t all{0xFFFF};
+    switch(filter) {
+      case Filter::trs:
+        set_channels(MidiSource::trs, all);
+        set_channels(MidiSource::usb, 0);
+        break;
+      case Filter::usb:
+        set_channels(MidiSource::trs, 0);
+        set_channels(MidiSource::usb, all);
+        break;
+      case Filter::split:
+        set_channels(MidiSource::trs, 1 << split_channels[0]);
+        set_channels(MidiSource::usb, 1 << split_channels[1]);
+        break;
+      default:
+        set_channels(MidiSource::trs, all);
+        set_channels(MidiSource::usb, all);
+        break;
+    }
+  }
+  Filter get_filter() { return filter; }
+
+  static const char* filter_name(Filter f) {
+    constexpr std::array<const char*, static_cast<size_t>(Filter::Count)> names{"All", "TRS", "USB", "Split"};
+    return names[static_cast<size_t>(f) % names.size()];
+  }
+
+  // Main loop, takes whatever the input has received
+  template <typename Input>
+  void take(Input& in, MidiSource source) {
+    Queue& q = pending[static_cast<size_t>(source)];
+    daisy::MidiEvent m;
+    uint32_t stamp;
+    while(in.next(m, stamp)) {
+      if(m.type < daisy::SystemCommon && !(get_channels(source) & (1 << (m.channel & 0x0F))))
+        continue;
+      if(!q.push({m, source, stamp}))
+        dropped++;
+    }
+  }
+
+  // After taking from every source. Moves what came in before cutoff
+  // into the queue, oldest first, TRS first for the same stamp.
+  void merge(uint32_t cutoff) {
+    for(;;) {
+      Queue* oldest = nullptr;
+      for(auto& q : pending) {
+        if(q.count == 0 || !stamped_before(q.front().stamp, cutoff))
+          continue;
+        if(!oldest || stamped_before(q.front().stamp, oldest->front().stamp))
+          oldest = &q;
+      }
+      if(!oldest)
+        return;
+      if(!merged.push(oldest->front()))
+        dropped++;
+      oldest->pop();
+    }
+  }
+
+  // Oldest first
+  bool pop(Event& e) {
+    if(merged.count == 0)
+      return false;
+    e = merged.front();
+    merged.pop();
+    return true;
+  }
+
+  uint32_t get_dropped() { return dropped; }
+};
+
+static MidiIn midi_in;
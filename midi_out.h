@@ -0,0 +1,95 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+//#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+#define LogPrint(...)
+
+// Notes and clock for the MIDI out jack. Messages are queued from the
+// audio callback as the voices start and stop and sent from the main
+// loop, the UART send blocks so it never runs in the callback.
+//
+// One writer (the audio callback, or the main loop with the callback held
+// off) and one reader (the main loop), so the ring just needs its two
+// indices published in the right order.
+class MidiOut {
+  public:
+  static constexpr size_t ring_size{256}; // power of 2
+
+  struct Message {
+    uint8_t bytes[3];
+    uint8_t len;
+  };
+
+  private:
+  std::array<Message, ring_size> ring{};
+  std::atomic<uint32_t> head{0}; // written by the producer
+  std::atomic<uint32_t> tail{0}; // written by the consumer
+  uint32_t dropped{0};
+
+  // Clock, 24 a quarter note
+  bool clock_on{false};
+  float clock_phase{0};
+
+  public:
+  // False when the ring is full, try again next block
+  bool note_on(uint8_t channel, uint8_t note, uint8_t velocity) {
+    return push({{static_cast<uint8_t>(0x90 | (channel & 0x0F)), static_cast<uint8_t>(note & 0x7F), static_cast<uint8_t>(velocity & 0x7F)}, 3});
+  }
+  bool note_off(uint8_t channel, uint8_t note) {
+    return push({{static_cast<uint8_t>(0x80 | (channel & 0x0F)), static_cast<uint8_t>(note & 0x7F), 0}, 3});
+  }
+
+  // Start / stop go out with it
+  void set_clock(bool on) {
+    if(on == clock_on)
+      return;
+    clock_on = on;
+    clock_phase = 0;
+    push({{static_cast<uint8_t>(on ? 0xFA : 0xFC), 0, 0}, 1});
+  }
+  bool get_clock() { return clock_on; }
+
+  // AUDIO CALLBACK, once per block. A sequencer step is a 16th so there
+  // are 6 clocks to a step.
+  void clock(float step_secs, size_t frames, float samplerate) {
+    if(!clock_on || step_secs <= 0)
+      return;
+    clock_phase += 6.0f * frames / (step_secs * samplerate);
+    while(clock_phase >= 1.0f) {
+      clock_phase -= 1.0f;
+      push({{0xF8, 0, 0}, 1});
+    }
+  }
+
+  // Main loop, send(bytes, n) for everything queued
+  template <typename Send>
+  void drain(Send send) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t h = head.load(std::memory_order_acquire);
+    while(t != h) {
+      Message m = ring[t % ring_size];
+      tail.store(++t, std::memory_order_release);
+      send(m.bytes, m.len);
+    }
+  }
+
+  uint32_t get_dropped() { return dropped; }
+
+  private:
+  // Never waits for the main loop, a full ring drops the message
+  bool push(const Message& m) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if(h - tail.load(std::memory_order_acquire) >= ring_size) {
+      dropped++;
+      return false;
+    }
+    ring[h % ring_size] = m;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+};
+
+static MidiOut midi_out;
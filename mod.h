@@ -0,0 +1,142 @@
+#pragma once
+#include "daisy_pod.h"
+#include "daisysp.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include "tables.h"
+
+//#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+#define LogPrint(...)
+
+// Control rate modulation. Sources are stepped once per audio block and
+// the routes are summed into one offset per destination that the Player
+// (and all its voices) read for the whole block.
+
+enum class ModSource : uint8_t {
+  lfo1,
+  lfo2,
+  Count
+};
+
+enum class ModDest : uint8_t {
+  cutoff,    // added to the 0-1 cutoff knob
+  detune,    // osc2 ratio, +-1 is +-an octave
+  delay_mix, // added to the 0-1 mix
+  pan,       // -1 left, 1 right
+  Count
+};
+
+enum class LfoShape : uint8_t {
+  sine,
+  tri,
+  saw,
+  square,
+  Count
+};
+
+inline const char* lfo_shape_name(LfoShape s) {
+  switch(s) {
+    case LfoShape::sine: return "Sine";
+    case LfoShape::tri: return "Tri";
+    case LfoShape::saw: return "Saw";
+    case LfoShape::square: return "Square";
+    default: return "?";
+  }
+}
+
+class Lfo {
+  float samplerate{0};
+  float phase{0};
+  float freq{1};
+  LfoShape shape{LfoShape::sine};
+
+  public:
+  void Init(float sr) { samplerate = sr; }
+  void set_freq(float f) { freq = f; }
+  void set_shape(LfoShape s) { shape = s; }
+
+  // Advance by a block and return the value for it, -1 to 1
+  float process(size_t frames) {
+    phase += freq * frames / samplerate;
+    if(phase >= 1.0f)
+      phase -= static_cast<int>(phase);
+    switch(shape) {
+      case LfoShape::sine: return tables::sin_cycle(phase);
+      case LfoShape::tri: return phase < 0.5f ? 4.0f * phase - 1.0f : 3.0f - 4.0f * phase;
+      case LfoShape::saw: return 2.0f * phase - 1.0f;
+      case LfoShape::square: return phase < 0.5f ? 1.0f : -1.0f;
+      default: return 0;
+    }
+  }
+};
+
+struct ModRoute {
+  ModSource src;
+  ModDest dst;
+  float depth;
+};
+
+class ModMatrix {
+  public:
+  static constexpr size_t max_routes{8};
+
+  private:
+  std::array<Lfo, 2> lfos;
+  std::array<float, static_cast<size_t>(ModSource::Count)> sources{};
+  std::array<float, static_cast<size_t>(ModDest::Count)> offsets{};
+
+  // Only the routes in use, so the cost is per route not per matrix cell
+  std::array<ModRoute, max_routes> routes{};
+  uint8_t num_routes{0};
+
+  public:
+  void Init(float samplerate) {
+    for(auto& lfo : lfos)
+      lfo.Init(samplerate);
+  }
+
+  Lfo& lfo(uint8_t i) { return lfos[i % lfos.size()]; }
+
+  // Adds or updates the src -> dst route, a depth of 0 removes it
+  void connect(ModSource src, ModDest dst, float depth) {
+    uint8_t i = 0;
+    while(i < num_routes && !(routes[i].src == src && routes[i].dst == dst))
+      i++;
+    if(depth == 0) {
+      if(i < num_routes)
+        routes[i] = routes[--num_routes];
+      offsets[static_cast<size_t>(dst)] = 0;
+      return;
+    }
+    if(i == num_routes) {
+      if(num_routes >= max_routes)
+        return;
+      num_routes++;
+    }
+    routes[i] = {src, dst, depth};
+  }
+
+  float depth(ModSource src, ModDest dst) {
+    for(uint8_t i = 0; i < num_routes; i++)
+      if(routes[i].src == src && routes[i].dst == dst)
+        return routes[i].depth;
+    return 0;
+  }
+
+  // Once per audio block
+  void process(size_t frames) {
+    if(num_routes == 0)
+      return;
+    for(size_t i = 0; i < lfos.size(); i++)
+      sources[i] = lfos[i].process(frames);
+    offsets.fill(0);
+    for(uint8_t i = 0; i < num_routes; i++) {
+      const ModRoute& r = routes[i];
+      offsets[static_cast<size_t>(r.dst)] += sources[static_cast<size_t>(r.src)] * r.depth;
+    }
+  }
+
+  float get(ModDest dst) { return offsets[static_cast<size_t>(dst)]; }
+};
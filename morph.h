@@ -0,0 +1,105 @@
+#pragma once
+#include "daisy_pod.h"
+#include <array>
+#include <cstdint>
+
+#include "arp.h"
+#include "controls.h"
+#include "player.h"
+#include "seq.h"
+
+//#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+#define LogPrint(...)
+
+// Two snapshots of a part's patch and a morph position between them.
+// Which controls differ is worked out when a snapshot is taken, so moving
+// the morph only touches those, and nothing is printed per control.
+//
+// Beside the Patch a snapshot keeps the part state that isn't in the
+// control table: the arp mode, the detune (Pod knob 1) and the sequencer
+// tempo.
+class Morph {
+  struct Snapshot {
+    Patch patch;
+    ArpMode arp_mode{ArpMode::asis};
+    float detune{0};
+    float tempo{0};
+  };
+  Snapshot a;
+  Snapshot b;
+  std::array<uint8_t, num_controls> diff{};
+  uint8_t num_diff{0};
+  bool diff_arp_mode{false};
+  bool diff_detune{false};
+  bool diff_tempo{false};
+  float pos{0};
+
+  public:
+  void store_a(const Patch& p, Player& player, Arp& arp, Seq& seq) {
+    store(a, p, player, arp, seq);
+  }
+  void store_b(const Patch& p, Player& player, Arp& arp, Seq& seq) {
+    store(b, p, player, arp, seq);
+  }
+  // Everything that differs, the controls and the other state
+  uint8_t get_num_diff() { return num_diff + diff_arp_mode + diff_detune + diff_tempo; }
+  float get_pos() { return pos; }
+
+  // t is 0 (all A) to 1 (all B). Continuous controls are interpolated,
+  // discrete ones (and the arp mode) are A below the midpoint and B from
+  // it, only applied when they aren't already. The patch follows so
+  // parameter locks put things back to the morphed values.
+  void set(float t, Player& player, Arp& arp, Seq& seq, Patch& patch) {
+    pos = t;
+    ArpMode mode = t < 0.5f ? a.arp_mode : b.arp_mode;
+    if(diff_arp_mode && arp.get_mode() != mode)
+      arp.set_mode(mode);
+    if(diff_detune)
+      player.set_detune(a.detune + (b.detune - a.detune) * t);
+    if(diff_tempo)
+      seq.set_tempo(a.tempo + (b.tempo - a.tempo) * t);
+    for(uint8_t i = 0; i < num_diff; i++) {
+      uint8_t c = diff[i];
+      const ControlDesc& desc = control_desc(c);
+      if(desc.discrete) {
+        uint8_t v = t < 0.5f ? a.patch[c] : b.patch[c];
+        if(patch.values[c] == v)
+          continue;
+        patch.values[c] = v;
+        desc.apply(player, arp, v);
+        continue;
+      }
+      float v = a.patch[c] + (b.patch[c] - a.patch[c]) * t;
+      patch.values[c] = static_cast<uint8_t>(v + 0.5f);
+      desc.apply(player, arp, v);
+    }
+  }
+
+  private:
+  void store(Snapshot& snap, const Patch& p, Player& player, Arp& arp, Seq& seq) {
+    snap.patch = p;
+    snap.arp_mode = arp.get_mode();
+    snap.detune = player.get_detune();
+    snap.tempo = seq.get_tempo();
+    update_diff();
+  }
+
+  void update_diff() {
+    num_diff = 0;
+    for(uint8_t c = 0; c < num_controls; c++) {
+      if(!control_desc(c).apply)
+        continue;
+      const Patch& pa = a.patch;
+      const Patch& pb = b.patch;
+      if(pa[c] == Patch::unset || pb[c] == Patch::unset || pa[c] == pb[c])
+        continue;
+      diff[num_diff++] = c;
+    }
+    // A snapshot that hasn't been taken has no tempo
+    bool both = a.tempo > 0 && b.tempo > 0;
+    diff_arp_mode = both && a.arp_mode != b.arp_mode;
+    diff_detune = both && a.detune != b.detune;
+    diff_tempo = both && a.tempo != b.tempo;
+    LogPrint("Morph: %u controls differ\n", num_diff);
+  }
+};
@@ -5,8 +5,18 @@
 #include <math.h>
 #include <vector>
 
+#include "placement.h"
+#include "tables.h"
+#include "tuning.h"
+#include "unison.h"
+
+#ifdef USB_MIDI
+// The USB port is MIDI, there's no serial log to print to
+#define LogPrint(...)
+#else
 #define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
-//#define LogPrint(...) 
+//#define LogPrint(...)
+#endif
 
 class Note {
   private:
@@ -15,16 +25,43 @@ class Note {
     float last_sig{-1.};
     bool last_gate{false};
 
+    // Cutoff knob 0-1 maps exponentially from 100Hz to samplerate / 3
+    static constexpr float cutoff_min{100};
+    float cutoff_octaves{0};
+
+    // Filter cutoff is only recalculated every control_div samples
+    uint8_t control_div{1};
+    uint8_t control_count{0};
+
   public:
     daisysp::Oscillator osc1;
     daisysp::Oscillator osc2;
     float detune = 0.; // freq difference between osc1 and osc2
+    float detune_mod = 1.; // from the mod matrix, multiplies detune
+    float freq{0};
     bool gate{false};
     uint8_t note{0};
+    uint8_t velocity{0};
+    uint8_t starts{0}; // counts triggers, for MIDI out to spot a repeat
+    float gain{1}; // chords share out the level between their voices
+
+    // Strummed notes hold the voice but start this many samples late
+    uint32_t pending{0};
+    daisy::NoteOnEvent pending_note{};
 
     daisysp::MoogLadder flt;
     daisysp::AdEnv ad_vca, ad_vcf;
 
+    // Unison replaces osc1 / osc2 when it has more than one saw. It's
+    // rendered a block ahead in prepare() and needs a second filter for
+    // the right side.
+    Unison unison;
+    daisysp::MoogLadder flt_r;
+    float amp{1};
+    float uni_l[Unison::max_block];
+    float uni_r[Unison::max_block];
+    size_t uni_pos{0};
+
     Note(float samplerate)
       : samplerate(samplerate) {
           LogPrint("Note Constructed: samplerate %f\n", samplerate);
@@ -36,6 +73,10 @@ class Note {
           osc2.SetAmp(1.0);
 
           flt.Init(samplerate);
+          flt_r.Init(samplerate);
+          if(samplerate > 0)
+            cutoff_octaves = log2f((samplerate / 3 + 1) / cutoff_min);
+          unison.Init(samplerate);
 
           ad_vca.Init(samplerate);
           ad_vcf.Init(samplerate);
@@ -44,22 +85,51 @@ class Note {
     bool note_match(daisy::NoteOnEvent& p) { return note == p.note; }
     bool note_match(daisy::NoteOffEvent& p) { return note == p.note; }
 
-    void note_on(daisy::NoteOnEvent& p) {
-      float freq{daisysp::mtof(p.note)}; 
+    void note_on(daisy::NoteOnEvent& p, float g = 1.0f, uint32_t delay = 0) {
+      gain = g;
+      note = p.note;
+      if(delay > 0) {
+        pending_note = p;
+        pending = delay;
+        gate = true;
+        return;
+      }
+      start(p, !gate);
+      gate = true;
+    }
+
+    void start(daisy::NoteOnEvent& p, bool retrigger) {
+      freq = tuning.freq(p.note);
       osc1.SetFreq(freq);
-      osc1.SetAmp(p.velocity / 127.0f);
-      osc2.SetFreq(freq * detune);
-      osc2.SetAmp(p.velocity / 127.0f);
-      if(!gate) {
+      osc1.SetAmp(gain * p.velocity / 127.0f);
+      osc2.SetFreq(freq * detune * detune_mod);
+      osc2.SetAmp(gain * p.velocity / 127.0f);
+      amp = gain * p.velocity / 127.0f;
+      velocity = p.velocity;
+      starts++;
+      unison.set_freq(freq);
+      if(retrigger) {
+        unison.reset();
         ad_vca.Trigger(true);
         ad_vcf.Trigger(true);
       }
-      gate = true;
-      note = p.note;
     }
 
     void note_off() {
       gate = false;
+      pending = 0;
+    }
+
+    // Change pitch without touching the envelopes, for legato transpose
+    void retune(uint8_t n) {
+      note = n;
+      pending_note.note = n;
+      if(pending > 0)
+        return;
+      freq = tuning.freq(n);
+      osc1.SetFreq(freq);
+      osc2.SetFreq(freq * detune * detune_mod);
+      unison.set_freq(freq);
     }
 
     void set_wave_shape(uint8_t wave_num) {
@@ -72,25 +142,63 @@ class Note {
     void set_vcf_decay(float t) { ad_vcf.SetTime(daisysp::AdEnvSegment::ADENV_SEG_DECAY, t); }
     void set_vca_decay(float t) { ad_vca.SetTime(daisysp::AdEnvSegment::ADENV_SEG_DECAY, t); }
     void set_detune(float t) { detune = t; }; // takes effect next note_on
+    // Control rate, retunes osc2 of a sounding note
+    void set_detune_mod(float ratio) {
+      detune_mod = ratio;
+      if(gate)
+        osc2.SetFreq(freq * detune * detune_mod);
+    }
+    void set_control_div(uint8_t div) { control_div = div; control_count = 0; }
+    bool unison_on() { return unison.get_count() > 1; }
+
+    // Once per block before process(). A strummed note that starts part
+    // way through a block comes in at the next one.
+    void prepare(size_t n) {
+      uni_pos = 0;
+      if(!gate || !unison_on())
+        return;
+      std::fill(uni_l, uni_l + n, 0.0f);
+      std::fill(uni_r, uni_r + n, 0.0f);
+      if(pending == 0)
+        unison.process(uni_l, uni_r, n);
+    }
 
-    float process(float vcf_freq, float vcf_res, float vcf_env_depth) {
-      if(!gate) return 0.;
+    HOT_CODE void process(float vcf_freq, float vcf_res, float vcf_env_depth, float& l, float& r) {
+      size_t pos = uni_pos++;
+      l = r = 0;
+      if(!gate) return;
+      if(pending > 0) {
+        if(--pending > 0)
+          return;
+        start(pending_note, true);
+      }
       float vca_env = ad_vca.Process();
-      if(!ad_vca.IsRunning()) return 0.;
+      if(!ad_vca.IsRunning()) return;
 
-      static daisy::MappedFloatValue vcf_freq_map{
-        100, samplerate / 3  + 1, 440,
-        daisy::MappedFloatValue::Mapping::log, "Hz"};
       float vcf_env = ad_vcf.Process();
-      float vcf_final_freq = vcf_freq + vcf_env * vcf_env_depth;
-      vcf_freq_map.SetFrom0to1(vcf_final_freq);
-      flt.SetFreq(vcf_freq_map.Get());
-      flt.SetRes(vcf_res);
+      if(control_count == 0) {
+        float vcf_final_freq = daisysp::fclamp(vcf_freq + vcf_env * vcf_env_depth, 0.0f, 1.0f);
+        float cutoff = cutoff_min * tables::exp2(cutoff_octaves * vcf_final_freq);
+        flt.SetFreq(cutoff);
+        flt.SetRes(vcf_res);
+        if(unison_on()) {
+          flt_r.SetFreq(cutoff);
+          flt_r.SetRes(vcf_res);
+        }
+      }
+      if(++control_count >= control_div)
+        control_count = 0;
+
+      if(unison_on()) {
+        l = flt.Process(uni_l[pos] * amp) * vca_env;
+        r = flt_r.Process(uni_r[pos] * amp) * vca_env;
+        return;
+      }
 
       // Apply the processing values
       float sig = (osc1.Process() + osc2.Process()) / 2.;
       sig = flt.Process(sig);
       sig *= vca_env;
-      return sig;
+      l = r = sig;
     }
 };
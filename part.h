@@ -0,0 +1,70 @@
+#pragma once
+#include "daisy_pod.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include "arp.h"
+#include "bank.h"
+#include "controls.h"
+#include "fx.h"
+#include "morph.h"
+#include "player.h"
+#include "seq.h"
+#include "transpose.h"
+
+//#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+#define LogPrint(...)
+
+// One timbre on one midi channel, with its own voices, patch, arp and
+// sequence. All parts play into the same FxBus and share the VoiceBudget.
+struct Part {
+  uint8_t channel;
+  Player player;
+  Arp arp;
+  Seq seq;
+  Patch patch;
+  Transposer transposer;
+  Morph morph;
+  // A patch from a sysex dump, applied at the next bar
+  Patch incoming;
+  bool incoming_ready{false};
+
+  Part(float samplerate, uint8_t channel, PatternBank& bank, FxBus& fx, VoiceBudget& budget)
+    : channel(channel)
+    , player(samplerate, fx, budget)
+    , arp(samplerate)
+    , seq(samplerate, bank) {
+    player.set_channel(channel);
+    for(auto [control, value] : control_defaults) {
+      patch[control] = value;
+      control_desc(control).apply(player, arp, value);
+    }
+  }
+};
+
+constexpr size_t num_parts{2};
+
+// AUDIO CALLBACK, everything after the sync input: moves the parts' arps
+// and sequencers on a block and renders the block through the FxBus. in
+// and out are interleaved stereo. The host renderer (host/golden.cpp)
+// runs the same code.
+HOT_CODE inline void render_parts(Part* parts, FxBus& fx, const float* in, float* out, size_t frames) {
+  for(size_t p = 0; p < num_parts; p++) {
+    parts[p].seq.process();
+    parts[p].arp.process();
+  }
+  // The first part's sequencer is the clock for synced delay times
+  fx.set_delay_step(parts[0].seq.get_step_secs(frames));
+
+  while(frames > 0) {
+    size_t n = std::min(frames, FxBus::max_block);
+    fx.begin(n);
+    for(size_t p = 0; p < num_parts; p++)
+      parts[p].player.render(n, in);
+    fx.process(out, n);
+    in += 2 * n;
+    out += 2 * n;
+    frames -= n;
+  }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+// Where the audio path lives. Built with make HOT_PLACEMENT=1 the audio
+// callback code goes in ITCM and the voice / effect state in DTCM, both
+// zero wait state. Otherwise everything goes where the linker script
+// puts it by default (code in flash through the cache, data in AXI SRAM).
+//
+// The DaisySP objects used inside (Oscillator, MoogLadder, AdEnv etc.)
+// are compiled into libdaisysp and stay in flash. Check where things
+// ended up with make mem-report.
+
+#ifdef HOT_PLACEMENT
+// Copied out of flash by the libDaisy startup code. Each function gets
+// its own .itcmram.n section, inline (comdat) and plain functions can't
+// share one.
+#define HOT_STR_(x) #x
+#define HOT_STR(x) HOT_STR_(x)
+#define HOT_CODE __attribute__((section(".itcmram." HOT_STR(__COUNTER__))))
+// Not zeroed at boot, only for objects that are constructed at runtime
+#define HOT_DATA __attribute__((section(".dtcmram_bss")))
+#else
+#define HOT_CODE
+#define HOT_DATA
+#endif
@@ -8,7 +8,14 @@
 #include <cstdarg>
 #include <array>
 #include <vector>
+#include "drive.h"
+#include "fx.h"
+#include "midi_out.h"
+#include "mod.h"
 #include "note.h"
+#include "placement.h"
+#include "rng.h"
+#include "sampler.h"
 
 //#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
 #define LogPrint(...) 
@@ -60,11 +67,45 @@ class KeyTracker {
   }
 };
 
-static uint32_t DSY_SDRAM_BSS reverb_heap[sizeof(daisysp::ReverbSc)];
+class Player;
+
+// The audio input played through a part, see Player::render
+enum class InputMode : uint8_t {
+  off,
+  right, // left stays the sync input
+  both,  // stereo, sync is off
+  Count
+};
+
+inline const char* input_mode_name(InputMode m) {
+  constexpr std::array<const char*, static_cast<size_t>(InputMode::Count)> names{"Off", "Right", "Stereo"};
+  return names[static_cast<size_t>(m) % names.size()];
+}
+
+// Shared by all the parts' Players, caps the number of voices sounding at
+// once across all of them. When it's full the part with the most voices
+// going gives one up.
+class VoiceBudget {
+  std::array<Player*, 8> players{};
+  size_t num_players{0};
+  size_t max{0};
+  size_t limit{0};
+
+  public:
+  void add(Player* p);
+  size_t get_max() { return max; }
+  size_t get_limit() { return limit; }
+  // Lowered by the Governor under load
+  void set_limit(size_t n);
+  size_t active();
+  // Frees voices until n more fit in the budget
+  // Returns how many of the n can start, never more than the limit
+  size_t make_room(size_t n = 1);
+};
 
 class Player {
   public:
-  static constexpr size_t poly{1};
+  static constexpr size_t poly{4};
 
   private:
   float vcf_env_depth = 0.;
@@ -73,75 +114,343 @@ class Player {
   float samplerate = 0;
 
   float last_note_total{-1.};
+  float detune{0}; // Pod knob 1, kept for the morph snapshots
+  ModMatrix mod;
+  float last_detune_mod{1};
 
-  daisysp::DelayLine<float, 48000> delay;
-  float delay_mix{0};
-  daisysp::Overdrive drive;
-  daisysp::ReverbSc* reverb = new(reverb_heap) daisysp::ReverbSc();
-  float reverb_wet{0.0};
-  float reverb_gain{0.25}; // Reverb output is SUPER LOUD so cut it
+  FxBus& fx;
+  VoiceBudget& budget;
+  // After the voices, before the FxBus
+  Drive drive_l, drive_r;
+  float buf_l[FxBus::max_block];
+  float buf_r[FxBus::max_block];
   //float gain{2.};
 
   // This initlizer kinda sucks, boo c++
-  std::array<Note, poly> notes{{{0}}}; //,{0},{0},{0},{0}}};
+  std::array<Note, poly> notes{{{0},{0},{0},{0}}};
+
+  // Humanize, each trigger loses up to human_vel velocity and starts up
+  // to human_time samples late
+  uint8_t human_vel{0};
+  uint16_t human_time{0};
+
+  // MIDI out, what's been sent for each voice. -1 is off.
+  struct SentNote {
+    bool on;
+    uint8_t note;
+    uint8_t starts;
+  };
+  std::array<SentNote, poly> sent{};
+  int8_t out_channel{-1};
+  uint8_t channel{0}; // the part's, where MIDI out goes when it's on
+
+  // Audio input through its own filter (the part's cutoff and resonance)
+  // and, as a trance gate, an envelope the part's notes trigger
+  InputMode input_mode{InputMode::off};
+  bool input_gate{false};
+  static constexpr float in_cutoff_min{100};
+  float in_cutoff_octaves{0};
+  daisysp::MoogLadder in_flt_l, in_flt_r;
+  daisysp::AdEnv in_env;
+
+  // Sample playback in place of the oscillators, when a sample is set
+  SampleVoice* sample_voice{nullptr};
+  const SampleInfo* sample{nullptr};
+
+  // Keyboard transpose, added as notes are triggered
+  int8_t transpose{0};
+  uint8_t transposed(uint8_t note) { return std::clamp(note + transpose, 0, 126); }
 
   public:
 
-  Player(float samplerate) : samplerate(samplerate) {
+  Player(float samplerate, FxBus& fx, VoiceBudget& budget)
+    : samplerate(samplerate)
+    , fx(fx)
+    , budget(budget) {
     for(auto& note : notes) {
       Note n{samplerate};
       note = n;
     }
-    delay.Init();
-    reverb->Init(samplerate);
-    reverb->SetLpFreq(18000.0f);
-    reverb->SetFeedback(0.85f);
+    mod.Init(samplerate);
+    in_flt_l.Init(samplerate);
+    in_flt_r.Init(samplerate);
+    in_env.Init(samplerate);
+    if(samplerate > 0)
+      in_cutoff_octaves = log2f((samplerate / 3 + 1) / in_cutoff_min);
+    budget.add(this);
   }
 
-  void play_chord(std::vector<daisy::NoteOnEvent>& keys) {
+  float get_samplerate() { return samplerate; }
+
+  // All the notes start on the same sample, or strum samples apart, and
+  // the voices for them are found in one go. Rests (127) are skipped.
+  void play_chord(const std::vector<uint8_t>& keys, uint32_t strum = 0, uint8_t velocity = 127) {
     for(auto& note : notes)
       note.note_off();
+    in_env.Trigger();
+    // One sample voice, it gets the first note
+    if(sampling()) {
+      auto first = std::find_if(keys.begin(), keys.end(), [](uint8_t k) { return k != 127; });
+      if(first != keys.end())
+        play_sample(transposed(*first), humanize(velocity), late());
+      else
+        sample_voice->note_off();
+      return;
+    }
 
-    for(size_t i = 0; i < std::min(poly, keys.size()); i++) {
-      notes[i].note_on(keys[i]);
+    size_t count = 0;
+    for(uint8_t k : keys)
+      count += k != 127;
+    count = std::min(poly, count);
+    if(count == 0)
+      return;
+    // Under load the governor may not leave room for the whole chord
+    count = budget.make_room(count);
+    if(count == 0)
+      return;
+
+    float gain = 1.0f / count;
+    size_t v = 0;
+    for(size_t i = 0; i < keys.size() && v < count; i++) {
+      if(keys[i] == 127)
+        continue;
+      daisy::NoteOnEvent key{0, transposed(keys[i]), humanize(velocity)};
+      notes[v].note_on(key, gain, strum * v + late());
+      v++;
     }
   }
 
   void play_rest() {
+    if(sample_voice)
+      sample_voice->note_off();
     for(auto& note : notes)
       note.note_off();
   }
   void play_note(daisy::NoteOnEvent& key) {
     for(auto& note : notes)
       note.note_off();
+    in_env.Trigger();
 
-    notes[0].note_on(key);
+    if(sampling()) {
+      play_sample(transposed(key.note), humanize(key.velocity), late());
+      return;
+    }
+    budget.make_room();
+    daisy::NoteOnEvent k{key};
+    k.note = transposed(key.note);
+    k.velocity = humanize(key.velocity);
+    notes[0].note_on(k, 1.0f, late());
     //LogPrint("Player.note_on last_note_total: %i\n", static_cast<int>(last_note_total * 1000.));
   }
 
+  void set_humanize_velocity(uint8_t velocity) {
+    LogPrint("Control Received: Humanize Vel -> %u\n", velocity);
+    human_vel = velocity;
+  }
+  void set_humanize_time(uint16_t samples) {
+    LogPrint("Control Received: Humanize Time -> %u\n", samples);
+    human_time = samples;
+  }
+  uint8_t humanize(uint8_t velocity) {
+    if(human_vel == 0)
+      return velocity;
+    uint8_t drop = rng.below(human_vel + 1);
+    return velocity > drop + 1 ? velocity - drop : 1;
+  }
+  uint32_t late() { return human_time ? rng.below(human_time + 1) : 0; }
+
+  // The voice is this part's own, see Sampler
+  void set_sample_voice(SampleVoice* v) { sample_voice = v; }
+  // nullptr goes back to the oscillators
+  void set_sample(const SampleInfo* s) {
+    LogPrint("Control Received: Sample -> %s\n", s ? s->path : "off");
+    if(s == sample)
+      return;
+    if(sample_voice)
+      sample_voice->note_off();
+    sample = s;
+  }
+  bool sampling() { return sample_voice && sample; }
+
+  // Note 60 plays the sample at its own pitch
+  void play_sample(uint8_t note, uint8_t velocity, uint32_t delay) {
+    float rate = tuning.freq(note) / tuning.freq(60) * sample->samplerate / samplerate;
+    sample_voice->note_on(sample, rate, velocity / 127.0f, delay);
+  }
+
+  // With legato the sounding notes move too, otherwise it waits for the
+  // next trigger
+  void set_transpose(int8_t t, bool legato) {
+    if(legato) {
+      for(auto& note : notes)
+        if(note.gate)
+          note.retune(std::clamp(note.note - transpose + t, 0, 126));
+    }
+    transpose = t;
+  }
+  int8_t get_transpose() { return transpose; }
+
+  size_t active_voices() {
+    size_t n = 0;
+    for(auto& note : notes)
+      n += note.gate;
+    return n;
+  }
+
+  // AUDIO CALLBACK, after the block. Compares the voices with what was
+  // sent, so notes go out on the block they really started in, strummed
+  // and late ones included, and every note on gets its note off.
+  void send_midi() {
+    for(size_t v = 0; v < poly; v++) {
+      const Note& note = notes[v];
+      SentNote& s = sent[v];
+      bool on = note.gate && note.pending == 0;
+      if(s.on && (!on || note.starts != s.starts || note.note != s.note)) {
+        if(!midi_out.note_off(out_channel, s.note))
+          continue;
+        s.on = false;
+      }
+      if(on && !s.on && midi_out.note_on(out_channel, note.note, note.velocity))
+        s = {true, note.note, note.starts};
+    }
+  }
+
+  // Cuts off the last sounding voice
+  void steal() {
+    for(size_t v = poly; v > 0; v--) {
+      if(notes[v - 1].gate) {
+        notes[v - 1].note_off();
+        return;
+      }
+    }
+  }
+
   // AUDIO CALLBACK
-  void AudioCallback(daisy::AudioHandle::InterleavingInputBuffer in,
-      daisy::AudioHandle::InterleavingOutputBuffer out,
-      size_t size)
-  {
-    float note_total{0};
-    for(size_t i = 0; i < size; i += 2) {
+  // Adds this part's block into the FxBus buffers. in is the interleaved
+  // audio input for the same n frames.
+  HOT_CODE void render(size_t n, const float* in) {
+    // Control rate, once per block for all voices
+    mod.process(n);
+    float cutoff = vcf_freq + mod.get(ModDest::cutoff);
+    fx.add_delay_mix_mod(mod.get(ModDest::delay_mix));
+    float detune_mod = 1.0f + mod.get(ModDest::detune);
+    if(detune_mod != last_detune_mod) {
       for(auto& note : notes)
-        note_total += note.process(vcf_freq, vcf_res, vcf_env_depth);
-      note_total /= poly;
-      note_total += delay.Read() * delay_mix;
-      note_total /= 1. + delay_mix;
-      delay.Write(note_total);
-      float rvb_out1{0}, rvb_out2{0};
-      reverb->Process(note_total, note_total, &rvb_out1, &rvb_out2);
-      // Apply gain after reverb processing because rvb feedback makes it 
-      // very loud
-      //note_total *= gain;
-      rvb_out1 *= reverb_gain;
-      rvb_out2 *= reverb_gain;
-      out[i] = rvb_out1 * reverb_wet + note_total * (1 - reverb_wet);
-      out[i + 1] = rvb_out2 * reverb_wet + note_total * (1 - reverb_wet);
+        note.set_detune_mod(detune_mod);
+      last_detune_mod = detune_mod;
+    }
+    float pan = daisysp::fclamp(mod.get(ModDest::pan), -1.0f, 1.0f);
+    float pan_l = std::min(1.0f, 1.0f - pan);
+    float pan_r = std::min(1.0f, 1.0f + pan);
+
+    static_assert(Unison::max_block >= FxBus::max_block);
+    static_assert(Drive::max_block >= FxBus::max_block);
+    for(auto& note : notes)
+      note.prepare(n);
+
+    for(size_t i = 0; i < n; i++) {
+      float total_l{0}, total_r{0};
+      for(auto& note : notes) {
+        float l, r;
+        note.process(cutoff, vcf_res, vcf_env_depth, l, r);
+        total_l += l;
+        total_r += r;
+      }
+      buf_l[i] = total_l;
+      buf_r[i] = total_r;
+    }
+
+    if(sample_voice)
+      sample_voice->process(buf_l, buf_r, n);
+    if(input_mode != InputMode::off)
+      process_input(in, cutoff, n);
+
+    drive_l.process(buf_l, n);
+    drive_r.process(buf_r, n);
+    if(out_channel >= 0)
+      send_midi();
+
+    for(size_t i = 0; i < n; i++) {
+      fx.mono[i] += 0.5f * (buf_l[i] + buf_r[i]);
+      fx.left[i] += buf_l[i] * pan_l;
+      fx.right[i] += buf_r[i] * pan_r;
+    }
+  }
+
+  void set_control_div(uint8_t div) {
+    for(auto& note : notes)
+      note.set_control_div(div);
+  }
+
+  // AUDIO CALLBACK. Straight from the input buffer onto the voices, then
+  // it gets the drive and FxBus along with them. Mono is one filter.
+  HOT_CODE void process_input(const float* in, float cutoff, size_t n) {
+    float freq = in_cutoff_min * tables::exp2(in_cutoff_octaves * daisysp::fclamp(cutoff, 0.0f, 1.0f));
+    in_flt_l.SetFreq(freq);
+    in_flt_l.SetRes(vcf_res);
+    if(input_mode == InputMode::right) {
+      for(size_t i = 0; i < n; i++) {
+        float g = input_gate ? in_env.Process() : 1.0f;
+        float s = in_flt_l.Process(in[2 * i + 1]) * g;
+        buf_l[i] += s;
+        buf_r[i] += s;
+      }
+      return;
+    }
+    in_flt_r.SetFreq(freq);
+    in_flt_r.SetRes(vcf_res);
+    for(size_t i = 0; i < n; i++) {
+      float g = input_gate ? in_env.Process() : 1.0f;
+      buf_l[i] += in_flt_l.Process(in[2 * i]) * g;
+      buf_r[i] += in_flt_r.Process(in[2 * i + 1]) * g;
+    }
+  }
+
+  void set_input_mode(InputMode m) { input_mode = m; }
+  InputMode get_input_mode() { return input_mode; }
+  void set_input_gate(bool on) { input_gate = on; }
+  bool get_input_gate() { return input_gate; }
+
+  void set_channel(uint8_t c) { channel = c; }
+  uint8_t get_channel() { return channel; }
+
+  // Sends this part's notes to MIDI out on channel, -1 to stop
+  void set_midi_out(int8_t channel) {
+    LogPrint("Control Received: MIDI Out -> %i\n", channel);
+    if(channel == out_channel)
+      return;
+    for(auto& s : sent) {
+      if(s.on)
+        midi_out.note_off(out_channel, s.note);
+      s.on = false;
     }
+    out_channel = channel;
+  }
+  int8_t get_midi_out() { return out_channel; }
+
+  // 0 is off
+  void set_drive(float amount) {
+    LogPrint("Control Received: Drive -> 0.%03i\n", static_cast<int>(1000 * amount));
+    drive_l.set_amount(amount);
+    drive_r.set_amount(amount);
+  }
+  // 1, 2 or 4 times
+  void set_drive_oversample(uint8_t factor) {
+    LogPrint("Control Received: Drive Oversample -> %u\n", factor);
+    drive_l.set_oversample(factor);
+    drive_r.set_oversample(factor);
+  }
+
+  // Saws per voice, 1 is the normal two oscillator voice
+  void set_unison(size_t count) {
+    LogPrint("Control Received: Unison -> %u\n", count);
+    for(auto& note : notes)
+      note.unison.set_count(count);
+  }
+  void set_unison_spread(float semitones) {
+    LogPrint("Control Received: Unison Spread -> 0.%03i\n", static_cast<int>(1000 * semitones));
+    for(auto& note : notes)
+      note.unison.set_spread(semitones);
   }
 
   // Controller changes
@@ -172,6 +481,7 @@ class Player {
     LogPrint("Control Received: VCA Attack -> 0.%03i\n", static_cast<int>(1000 * val));
     for(auto& note : notes)
       note.set_vca_attack(val); // secs
+    in_env.SetTime(daisysp::AdEnvSegment::ADENV_SEG_ATTACK, val);
   }
   void set_envelope_d_vca(float val) {
     if(val <= 0.007)
@@ -179,6 +489,7 @@ class Player {
     LogPrint("Control Received: VCA Decay -> 0.%03i\n", static_cast<int>(1000 * val));
     for(auto& note : notes)
       note.set_vca_decay(val); // secs
+    in_env.SetTime(daisysp::AdEnvSegment::ADENV_SEG_DECAY, val);
   }
   void set_envelope_a_vcf(float val) {
     if(val <= 0.007)
@@ -194,33 +505,72 @@ class Player {
     for(auto& note : notes)
       note.set_vcf_decay(val); // secs
   }
-  void set_delay_time(float val) {
-    LogPrint("Control Received: Delay Delay -> 0.%03i\n", static_cast<int>(1000 * val));
-    delay.SetDelay(val);
+  // The effects are shared by all the parts
+  void set_delay_time(float val) { fx.set_delay_time(val); }
+  void set_delay_sync(uint8_t division) { fx.set_delay_sync(division); }
+  uint8_t get_delay_sync() { return fx.get_delay_sync(); }
+  void set_delay_damp_freq(float freq) { fx.set_delay_damp_freq(freq); }
+  void set_delay_mix(float val) { fx.set_delay_mix(val); }
+  void set_reverb_damp_freq(float val) { fx.set_reverb_damp_freq(val); }
+  void set_reverb_feedback(float val) { fx.set_reverb_feedback(val); }
+  void set_reverb_wet(float val) { fx.set_reverb_wet(val); }
+
+  void set_lfo_rate(uint8_t lfo, float hz) {
+    LogPrint("Control Received: LFO %u rate -> %i.%03i\n", lfo, static_cast<int>(hz), static_cast<int>(1000 * hz) % 1000);
+    mod.lfo(lfo).set_freq(hz);
   }
-  void set_delay_mix(float val) {
-    LogPrint("Control Received: Delay Mix -> 0.%03i\n", static_cast<int>(1000 * val));
-    delay_mix = val;
-    }
-  void set_reverb_damp_freq(float val) {
-    static daisy::MappedFloatValue rv_freq_map{
-      100, samplerate / 3  + 1, 440,
-        daisy::MappedFloatValue::Mapping::log, "Hz"};
-    rv_freq_map.SetFrom0to1(val);
-    LogPrint("Control Received: Reverb Freq -> 0.%03i\n", static_cast<int>(1000 * rv_freq_map.Get()));
-    reverb->SetLpFreq(val);
-  }
-  void set_reverb_feedback(float val) {
-    LogPrint("Control Received: Reverb Feedback -> 0.%03i\n", static_cast<int>(1000 * val));
-    reverb->SetFeedback(val);
-  }
-  void set_reverb_wet(float val) {
-    LogPrint("Control Received: Reverb wet -> 0.%03i\n", static_cast<int>(1000 * val));
-    reverb_wet = val;
+  void set_lfo_shape(uint8_t lfo, LfoShape shape) { mod.lfo(lfo).set_shape(shape); }
+  void set_mod_depth(ModSource src, ModDest dst, float depth) {
+    LogPrint("Control Received: Mod %u -> %u depth 0.%03i\n", src, dst, static_cast<int>(1000 * depth));
+    mod.connect(src, dst, depth);
   }
+
   void set_detune(float val) {
     LogPrint("Control Received: Detune -> 0.%03i\n", static_cast<int>(1000 * val));
+    detune = val;
     for(auto& note : notes)
       note.set_detune(val);
   }
+  float get_detune() { return detune; }
 };
+
+inline void VoiceBudget::add(Player* p) {
+  if(num_players >= players.size())
+    return;
+  players[num_players++] = p;
+  max += Player::poly;
+  limit = max;
+}
+
+inline void VoiceBudget::set_limit(size_t n) {
+  limit = std::clamp<size_t>(n, 1, max);
+  make_room(0);
+}
+
+inline size_t VoiceBudget::active() {
+  size_t n = 0;
+  for(size_t i = 0; i < num_players; i++)
+    n += players[i]->active_voices();
+  return n;
+}
+
+inline size_t VoiceBudget::make_room(size_t n) {
+  n = std::min(n, limit);
+  size_t in_use = active();
+  while(in_use + n > limit) {
+    Player* victim = nullptr;
+    size_t most = 0;
+    for(size_t i = 0; i < num_players; i++) {
+      size_t v = players[i]->active_voices();
+      if(v > most) {
+        most = v;
+        victim = players[i];
+      }
+    }
+    if(!victim)
+      break;
+    victim->steal();
+    in_use--;
+  }
+  return std::min(n, limit - std::min(in_use, limit));
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include "daisy_pod.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#ifdef USB_MIDI
+// The USB port is MIDI, there's no serial log to print to
+#define LogPrint(...)
+#else
+#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+//#define LogPrint(...)
+#endif
+
+// Everything that changes the synth from outside the audio callback,
+// stamped with the number of frames rendered so far. With the log of a
+// session the same Controller / Player code can be run again block by
+// block and produce the same audio.
+
+enum class EventType : uint8_t {
+  midi,     // data: type, channel, data[0]; value: data[1]
+  pod,      // data: PodState flags, encoder increment; value: knob 1 (float bits)
+  sync,     // value: tempo
+  arp_tick, // Arp::update played something
+  seq_tick, // Seq::update moved on a step
+  governor, // data: level
+  morph,    // data: part; value: position (float bits)
+  control,  // data: part, control, value. A patch value from a sysex dump
+};
+
+struct Event {
+  uint32_t sample;
+  EventType type;
+  uint8_t data[3];
+  uint32_t value;
+};
+
+constexpr size_t event_log_size{4096};
+static Event DSY_SDRAM_BSS event_log[event_log_size];
+
+class Recorder {
+  uint32_t clock{0}; // frames rendered
+  uint32_t count{0}; // events recorded, wraps the log
+
+  public:
+  // Audio callback, after the block has been rendered
+  void advance(size_t frames) { clock += frames; }
+  uint32_t now() { return clock; }
+
+  // Called from both the audio callback and the main loop, the main loop
+  // side must hold a ScopedIrqBlocker
+  void record(EventType type, uint8_t d0 = 0, uint8_t d1 = 0, uint8_t d2 = 0, uint32_t value = 0) {
+    Event& e = event_log[count % event_log_size];
+    e.sample = clock;
+    e.type = type;
+    e.data[0] = d0;
+    e.data[1] = d1;
+    e.data[2] = d2;
+    e.value = value;
+    count++;
+  }
+
+  void record_midi(daisy::MidiEvent& m) {
+    record(EventType::midi, m.type, m.channel, m.data[0], m.data[1]);
+  }
+
+  void record_float(EventType type, uint8_t d0, uint8_t d1, float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    record(type, d0, d1, 0, bits);
+  }
+
+  // Print the log oldest first over the USB serial log, one event a line.
+  // Nothing in a USB MIDI build.
+  void dump() {
+#ifndef USB_MIDI
+    uint32_t first = count > event_log_size ? count - event_log_size : 0;
+    LogPrint("# podsynth events %u%s\n", count - first, first ? " (wrapped)" : "");
+    for(uint32_t i = first; i < count; i++) {
+      Event& e = event_log[i % event_log_size];
+      LogPrint("%08lx %02x %02x %02x %02x %08lx\n",
+          static_cast<unsigned long>(e.sample), static_cast<unsigned>(e.type),
+          e.data[0], e.data[1], e.data[2], static_cast<unsigned long>(e.value));
+    }
+#endif
+  }
+
+  // Reads back a line written by dump()
+  static bool parse(const char* line, Event& e) {
+    unsigned long sample, value;
+    unsigned type, d0, d1, d2;
+    if(line[0] == '#')
+      return false;
+    if(std::sscanf(line, "%lx %x %x %x %x %lx", &sample, &type, &d0, &d1, &d2, &value) != 6)
+      return false;
+    e.sample = sample;
+    e.type = static_cast<EventType>(type);
+    e.data[0] = d0;
+    e.data[1] = d1;
+    e.data[2] = d2;
+    e.value = value;
+    return true;
+  }
+
+  static float as_float(const Event& e) {
+    float f;
+    std::memcpy(&f, &e.value, sizeof(f));
+    return f;
+  }
+};
+
+// Runs a log back through the synth. apply(event) is called for every
+// event due before a block, render(frames) renders one block. The block
+// size must match the recording (pod.AudioBlockSize()) and the log has to
+// start from boot for the output to match.
+template <typename Apply, typename Render>
+void replay(const Event* log, size_t count, size_t block, uint32_t frames, Apply apply, Render render) {
+  size_t next = 0;
+  for(uint32_t clock = 0; clock < frames; clock += block) {
+    while(next < count && log[next].sample <= clock)
+      apply(log[next++]);
+    render(block);
+  }
+}
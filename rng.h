@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+
+//#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+#define LogPrint(...)
+
+// xorshift32, 4 bytes of state. Not for anything but music.
+//
+// There's one shared by everything and it's seeded the same at every
+// boot. It's only drawn from in the main loop (arp / seq ticks and the
+// triggers they make), which the Recorder logs in order, so a replayed
+// session draws the same numbers.
+class Rng {
+  static constexpr uint32_t default_seed{0x9E3779B9};
+  uint32_t state{default_seed};
+
+  public:
+  void seed(uint32_t s) { state = s ? s : default_seed; }
+
+  uint32_t next() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  }
+
+  // 0 to n - 1
+  uint32_t below(uint32_t n) {
+    return static_cast<uint32_t>((static_cast<uint64_t>(next()) * n) >> 32);
+  }
+
+  // True percent times out of 100
+  bool chance(uint8_t percent) {
+    return percent >= 100 || below(100) < percent;
+  }
+};
+
+static Rng rng;
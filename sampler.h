@@ -0,0 +1,336 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "placement.h"
+
+//#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+#define LogPrint(...)
+
+#ifndef DSY_SDRAM_BSS
+#define DSY_SDRAM_BSS // host
+#endif
+
+// Sample playback streamed off the SD card.
+//
+// Each sample keeps its start (the attack) in SDRAM, read at boot, so a
+// note plays the moment it's triggered. The rest streams into a ring of
+// two chunks per voice, also in SDRAM. The main loop reads the next
+// chunk of the file into whichever half has been played while the other
+// half plays. Reads only happen in Sampler::service(), never in the audio
+// callback.
+//
+// Files go through SampleFile, SdSampleFile on the Pod and HostSampleFile
+// over plain files on a PC, so the read ahead and underruns can be
+// checked off the hardware.
+
+class SampleFile {
+  public:
+  virtual bool open(const char* path) = 0;
+  virtual void close() = 0;
+  virtual bool seek(uint32_t offset) = 0;
+  // Bytes read, short at the end of the file
+  virtual size_t read(void* dst, size_t bytes) = 0;
+};
+
+struct SampleInfo {
+  bool loaded{false};
+  uint8_t channels{0};
+  uint32_t samplerate{0};
+  uint32_t frames{0};
+  uint32_t data_offset{0}; // where the frames start in the file
+  uint32_t attack_frames{0};
+  int16_t* attack{nullptr};
+  char path[24]{};
+
+  uint32_t frame_bytes() const { return 2 * channels; }
+};
+
+// 16 bit PCM WAV, mono or stereo. Leaves the file anywhere.
+inline bool parse_wav(SampleFile& f, SampleInfo& info) {
+  auto le16 = [](const uint8_t* b) { return static_cast<uint32_t>(b[0] | b[1] << 8); };
+  auto le32 = [&](const uint8_t* b) { return le16(b) | le16(b + 2) << 16; };
+  uint8_t h[16];
+  if(f.read(h, 12) != 12 || std::memcmp(h, "RIFF", 4) || std::memcmp(h + 8, "WAVE", 4))
+    return false;
+  uint32_t offset = 12;
+  bool fmt = false;
+  for(;;) {
+    if(f.read(h, 8) != 8)
+      return false;
+    uint32_t size = le32(h + 4);
+    offset += 8;
+    if(!std::memcmp(h, "data", 4)) {
+      if(!fmt)
+        return false;
+      info.data_offset = offset;
+      info.frames = size / info.frame_bytes();
+      return true;
+    }
+    if(!std::memcmp(h, "fmt ", 4)) {
+      if(size < 16 || f.read(h, 16) != 16)
+        return false;
+      uint32_t channels = le16(h + 2);
+      if(le16(h) != 1 || le16(h + 14) != 16 || channels < 1 || channels > 2)
+        return false;
+      info.channels = channels;
+      info.samplerate = le32(h + 4);
+      fmt = true;
+    }
+    // Chunks are padded to an even size
+    offset += size + (size & 1);
+    if(!f.seek(offset))
+      return false;
+  }
+}
+
+class SampleVoice {
+  public:
+  static constexpr size_t chunk_frames{2048};
+  static constexpr size_t ring_frames{2 * chunk_frames};
+  // Fade on note off, no click
+  static constexpr uint16_t release_frames{64};
+
+  private:
+  int16_t* ring{nullptr}; // ring_frames stereo frames
+  SampleFile* file{nullptr};
+
+  // Main loop
+  const SampleInfo* open_sample{nullptr};
+  bool restart{false};
+  uint32_t next_read{0}; // frame in the file
+
+  // Frames after the attack, read into the ring / finished with by the
+  // audio. filled is only reset with the callback held off.
+  std::atomic<uint32_t> filled{0};
+  std::atomic<uint32_t> played{0};
+
+  // Audio callback
+  const SampleInfo* sample{nullptr};
+  bool active{false};
+  bool gate{false};
+  uint32_t pending{0}; // samples late, like a strummed Note
+  uint32_t pos{0};
+  float frac{0};
+  float rate{1};
+  float gain{1};
+  uint16_t fade{0};
+  uint32_t underruns{0};
+
+  public:
+  void Init(int16_t* ring_mem, SampleFile* f) {
+    ring = ring_mem;
+    file = f;
+  }
+
+  // Main loop, with the callback held off. rate is file frames a sample.
+  void note_on(const SampleInfo* s, float r, float g, uint32_t delay = 0) {
+    sample = s;
+    rate = r;
+    gain = g;
+    pending = delay;
+    pos = 0;
+    frac = 0;
+    filled.store(0, std::memory_order_relaxed);
+    played.store(0, std::memory_order_relaxed);
+    restart = true;
+    active = true;
+    gate = true;
+  }
+
+  void note_off() {
+    if(gate)
+      fade = release_frames;
+    gate = false;
+  }
+
+  uint32_t get_underruns() { return underruns; }
+
+  // Main loop, reads at most one chunk. Returns whether it read anything.
+  bool service() {
+    if(restart) {
+      restart = false;
+      if(open_sample != sample) {
+        file->close();
+        open_sample = file->open(sample->path) ? sample : nullptr;
+      }
+      next_read = sample->attack_frames;
+      if(open_sample && !file->seek(sample->data_offset + next_read * sample->frame_bytes()))
+        open_sample = nullptr;
+    }
+    if(!open_sample || next_read >= open_sample->frames)
+      return false;
+    uint32_t f = filled.load(std::memory_order_relaxed);
+    if(f + chunk_frames > played.load(std::memory_order_acquire) + ring_frames)
+      return false;
+
+    // The ring is a whole number of chunks so a chunk never wraps
+    const uint32_t fb = open_sample->frame_bytes();
+    size_t want = std::min<size_t>(chunk_frames, open_sample->frames - next_read);
+    size_t got = file->read(ring + (f % ring_frames) * 2, want * fb) / fb;
+    // Mono is read packed, spread it out to the ring's stereo frames
+    if(open_sample->channels == 1) {
+      int16_t* dst = ring + (f % ring_frames) * 2;
+      for(size_t i = got; i > 0; i--)
+        dst[2 * (i - 1)] = dst[2 * (i - 1) + 1] = dst[i - 1];
+    }
+    if(got < want) // read error, play what's there
+      next_read = open_sample->frames;
+    else
+      next_read += got;
+    filled.store(f + got, std::memory_order_release);
+    return got > 0;
+  }
+
+  // AUDIO CALLBACK, adds the block into l and r. An underrun holds the
+  // position until the data is there, rather than playing stale ring.
+  HOT_CODE void process(float* l, float* r, size_t n) {
+    if(!active)
+      return;
+    const uint32_t attack = sample->attack_frames;
+    const uint32_t avail = attack + filled.load(std::memory_order_acquire);
+    constexpr float scale{1.0f / 32768};
+    for(size_t i = 0; i < n; i++) {
+      if(pending > 0) {
+        pending--;
+        continue;
+      }
+      if(pos + 1 >= sample->frames) {
+        active = false;
+        break;
+      }
+      if(pos + 1 >= avail) {
+        underruns++;
+        continue;
+      }
+      float env = gain;
+      if(!gate) {
+        if(fade == 0) {
+          active = false;
+          break;
+        }
+        env *= static_cast<float>(fade--) / release_frames;
+      }
+      const int16_t* a = frame(pos);
+      const int16_t* b = frame(pos + 1);
+      float fl = a[0] + (b[0] - a[0]) * frac;
+      float fr = a[1] + (b[1] - a[1]) * frac;
+      l[i] += fl * scale * env;
+      r[i] += fr * scale * env;
+      frac += rate;
+      uint32_t step = static_cast<uint32_t>(frac);
+      pos += step;
+      frac -= step;
+    }
+    played.store(pos > attack ? pos - attack : 0, std::memory_order_release);
+  }
+
+  private:
+  // Stereo frame, the attack is stored stereo like the ring
+  const int16_t* frame(uint32_t i) const {
+    if(i < sample->attack_frames)
+      return sample->attack + 2 * i;
+    return ring + 2 * ((i - sample->attack_frames) % ring_frames);
+  }
+};
+
+// The sample slots, 0.wav to 7.wav in the root of the card, and a voice
+// for each part
+class Sampler {
+  public:
+  static constexpr size_t num_slots{8};
+  static constexpr size_t num_voices{2};
+  static constexpr size_t attack_max{4096};
+
+  private:
+  std::array<SampleInfo, num_slots> slots{};
+  std::array<SampleVoice, num_voices> voices{};
+  SampleFile* loader{nullptr};
+
+  public:
+  // files: one to load with, then one for each voice
+  void Init(SampleFile* const* files, int16_t* attack_mem, int16_t* ring_mem) {
+    loader = files[0];
+    for(size_t i = 0; i < num_slots; i++)
+      slots[i].attack = attack_mem + i * attack_max * 2;
+    for(size_t i = 0; i < num_voices; i++)
+      voices[i].Init(ring_mem + i * SampleVoice::ring_frames * 2, files[i + 1]);
+  }
+
+  // Main loop, at boot. dir ends in a /. Returns how many loaded.
+  size_t load(const char* dir) {
+    size_t count = 0;
+    for(size_t i = 0; i < num_slots; i++) {
+      SampleInfo& s = slots[i];
+      std::snprintf(s.path, sizeof(s.path), "%s%u.wav", dir, static_cast<unsigned>(i));
+      s.loaded = loader->open(s.path) && parse_wav(*loader, s) && load_attack(s);
+      loader->close();
+      count += s.loaded;
+      LogPrint("Sampler: %s %s, %u frames\n", s.path, s.loaded ? "ok" : "missing", s.frames);
+    }
+    return count;
+  }
+
+  const SampleInfo* slot(size_t i) { return i < num_slots && slots[i].loaded ? &slots[i] : nullptr; }
+  SampleVoice& voice(size_t i) { return voices[i % num_voices]; }
+
+  // Main loop, tops up every voice's ring
+  void service() {
+    for(auto& v : voices)
+      v.service();
+  }
+
+  private:
+  // The attack is cut so the first streamed read starts on a 512 byte
+  // sector, then every chunk read after it is whole sectors
+  bool load_attack(SampleInfo& s) {
+    const uint32_t fb = s.frame_bytes();
+    uint32_t frames = std::min<uint32_t>(attack_max, s.frames);
+    uint32_t end = s.data_offset + frames * fb;
+    uint32_t trim = end % 512;
+    if(frames == attack_max && trim % fb == 0 && trim / fb < frames / 2)
+      frames -= trim / fb;
+    s.attack_frames = frames;
+    if(!loader->seek(s.data_offset))
+      return false;
+    int16_t* dst = s.attack;
+    size_t got = loader->read(dst, frames * fb) / fb;
+    if(s.channels == 1)
+      for(size_t i = got; i > 0; i--)
+        dst[2 * (i - 1)] = dst[2 * (i - 1) + 1] = dst[i - 1];
+    return got == frames;
+  }
+};
+
+#ifndef __arm__
+// Host stand-in for SdSampleFile
+class HostSampleFile : public SampleFile {
+  FILE* f{nullptr};
+
+  public:
+  bool open(const char* path) override {
+    close();
+    f = std::fopen(path, "rb");
+    return f != nullptr;
+  }
+  void close() override {
+    if(f)
+      std::fclose(f);
+    f = nullptr;
+  }
+  bool seek(uint32_t offset) override { return f && std::fseek(f, offset, SEEK_SET) == 0; }
+  size_t read(void* dst, size_t bytes) override { return f ? std::fread(dst, 1, bytes, f) : 0; }
+};
+#endif
+
+// Same trick as the bank, this is far too big for SRAM. Only main() hands
+// them to the Sampler, inline so the host tools don't warn they're unused.
+inline int16_t DSY_SDRAM_BSS sample_attack_mem[Sampler::num_slots * Sampler::attack_max * 2];
+inline int16_t DSY_SDRAM_BSS sample_ring_mem[Sampler::num_voices * SampleVoice::ring_frames * 2];
+
+static Sampler sampler;
@@ -0,0 +1,34 @@
+#pragma once
+#include "daisy_pod.h"
+
+#include "sampler.h"
+
+//#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+#define LogPrint(...)
+
+// SampleFile over FatFS on the Pod's SD card. The FIL has to be somewhere
+// the SD DMA can reach, so these live in plain static SRAM (not DTCM).
+// Reads go straight into the SDRAM attack and ring buffers.
+class SdSampleFile : public SampleFile {
+  FIL fil;
+  bool is_open{false};
+
+  public:
+  bool open(const char* path) override {
+    close();
+    is_open = f_open(&fil, path, FA_READ) == FR_OK;
+    return is_open;
+  }
+  void close() override {
+    if(is_open)
+      f_close(&fil);
+    is_open = false;
+  }
+  bool seek(uint32_t offset) override { return is_open && f_lseek(&fil, offset) == FR_OK; }
+  size_t read(void* dst, size_t bytes) override {
+    UINT got = 0;
+    if(!is_open || f_read(&fil, dst, bytes, &got) != FR_OK)
+      return 0;
+    return got;
+  }
+};
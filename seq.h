@@ -1,34 +1,94 @@
 #pragma once
 #include "daisy_pod.h"
 #include "daisysp.h"
+#include <algorithm>
 #include <array>
 #include <vector>
 #include "arp.h"
+#include "bank.h"
+#include "controls.h"
 #include "player.h"
+#include "rng.h"
 
 //#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
 #define LogPrint(...) 
 
+enum class StepMode : uint8_t {
+  arp,    // notes go to the arpeggiator
+  chord,  // all the notes at once, or strummed
+  single, // just the first note
+  Count
+};
+
 struct Step {
   std::vector<uint8_t> notes;
+  StepMode mode{StepMode::arp};
+  uint16_t strum{0}; // samples between chord notes
+  uint8_t probability{100}; // percent chance the step plays
+
+  // Parameter locks, sorted by control. Most steps have none.
+  std::array<ParamLock, PatternBank::max_locks> locks{};
+  uint8_t num_locks{0};
+
+  void lock(uint8_t control, uint8_t value) {
+    uint8_t i = 0;
+    while(i < num_locks && locks[i].control < control)
+      i++;
+    if(i < num_locks && locks[i].control == control) {
+      locks[i].value = value;
+      return;
+    }
+    if(num_locks >= locks.size())
+      return;
+    for(uint8_t j = num_locks; j > i; j--)
+      locks[j] = locks[j - 1];
+    locks[i] = {control, value};
+    num_locks++;
+  }
+
+  void clear_locks() { num_locks = 0; }
+
+  void next_mode() {
+    mode = static_cast<StepMode>((static_cast<uint8_t>(mode) + 1) % static_cast<uint8_t>(StepMode::Count));
+  }
 };
 
+// Short enough to share the edit screen with the step's notes
+constexpr std::array<const char*, static_cast<size_t>(StepMode::Count)> step_mode_names{
+  "Arp", "Chd", "One"};
+
 
 class Seq {
   public:
+  static constexpr size_t max_chain{16};
 
   private:
   daisysp::Metro tick{};
   bool next{false};
   bool paused{false};
+  float step_len{0.25};
 
+  PatternBank& bank;
   std::vector<Step> steps{};
   uint8_t current_step{0};
+  uint8_t pattern{0};
+
+  // The queued pattern is copied out of the bank into next_steps ahead of
+  // the bar boundary, at the boundary the two buffers are just swapped.
+  std::vector<Step> next_steps{};
+  bool next_ready{false};
+  int queued{-1};
+
+  // Song mode, the chain is played in order and loops
+  std::array<uint8_t, max_chain> chain{};
+  uint8_t chain_len{0};
+  uint8_t chain_pos{0};
 
   public:
-  Seq(float samplerate) {
+  Seq(float samplerate, PatternBank& bank) : bank(bank) {
     tick.Init(4.0, samplerate);
-    steps.reserve(16);
+    steps.reserve(PatternBank::max_steps);
+    next_steps.reserve(PatternBank::max_steps);
     add_step();
   }
   void step_inc(int inc) { 
@@ -40,20 +100,31 @@ class Seq {
   void prev_step() {
     step_inc(-1);
   }
+  // Popping an empty step clears its parameter locks
   void pop_note() {
-    steps[current_step].notes.pop_back();
+    if(steps[current_step].notes.size() > 0)
+      steps[current_step].notes.pop_back();
+    else
+      steps[current_step].clear_locks();
   }
   void push_note(uint8_t note) {
+    if(steps[current_step].notes.size() >= PatternBank::max_notes)
+      return;
     steps[current_step].notes.push_back(note);
   }
   void set_arp(Arp& arp) {
-    arp.set_notes(steps[current_step].notes);
+    if(steps[current_step].mode == StepMode::arp)
+      arp.set_notes(steps[current_step].notes);
+    else
+      arp.clear();
   }
   int get_num_steps() { return steps.size(); }
   Step& get_step() {
     return steps[current_step];
   }
   void add_step() {
+    if(steps.size() >= PatternBank::max_steps)
+      return;
     steps.push_back(Step{});
   }
   void del_step() {
@@ -73,27 +144,141 @@ class Seq {
   void pause_toggle() {
     paused = !paused;
   }
+  bool is_paused() { return paused; }
 
   uint8_t get_step_num() { return current_step; }
   Step& step() { return steps[current_step]; }
   Step& step(uint8_t s) { return steps[s]; }
 
   void set_tempo(float secs) {
+    step_len = secs;
     tick.SetFreq(1.0 / secs);
   }
+  float get_tempo() { return step_len; }
+  // process() only runs once per audio block so a step really lasts
+  // block_frames times the length the metro is set to
+  float get_step_secs(size_t block_frames) { return step_len * block_frames; }
+
+  // Pattern bank
+  uint8_t get_pattern() { return pattern; }
+  int get_queued() { return queued; }
+  uint8_t get_chain_len() { return chain_len; }
+
+  void store(uint8_t slot) {
+    StoredPattern& p = bank.pattern(slot);
+    p.num_steps = steps.size();
+    for(size_t i = 0; i < steps.size(); i++) {
+      p.steps[i].num_notes = steps[i].notes.size();
+      std::copy(steps[i].notes.begin(), steps[i].notes.end(), p.steps[i].notes.begin());
+      p.steps[i].num_locks = steps[i].num_locks;
+      p.steps[i].locks = steps[i].locks;
+      p.steps[i].mode = static_cast<uint8_t>(steps[i].mode);
+      p.steps[i].strum = steps[i].strum;
+      p.steps[i].probability = steps[i].probability;
+    }
+    // Already copied out for the next bar, copy it again
+    if(queued == slot)
+      next_ready = false;
+    LogPrint("Seq::store %u steps -> slot %u\n", p.num_steps, slot);
+  }
+
+  // Play slot from the next bar, replaces any chain
+  void queue(uint8_t slot) {
+    chain[0] = slot;
+    chain_len = 1;
+    chain_pos = 0;
+    queue_slot(slot);
+  }
+
+  void chain_append(uint8_t slot) {
+    if(chain_len >= max_chain)
+      return;
+    chain[chain_len++] = slot;
+    if(queued < 0)
+      queue_slot(chain[chain_pos]);
+  }
 
-  void update(Player& player, Arp& arp) {
-    if(!next || paused) return;
+  // The slot was changed in the bank. If it's playing it's queued again
+  // so the new steps come in whole at the next bar.
+  void reload(uint8_t slot) {
+    if(queued == slot)
+      next_ready = false;
+    else if(queued < 0 && pattern == slot)
+      queue_slot(slot);
+  }
+
+  void chain_clear() {
+    chain_len = 0;
+    chain_pos = 0;
+  }
+
+  // Copy the queued pattern out of the bank, runs in the main loop
+  void prefetch() {
+    if(queued < 0 || next_ready)
+      return;
+    StoredPattern& p = bank.pattern(queued);
+    next_steps.resize(std::max<size_t>(p.num_steps, 1));
+    for(size_t i = 0; i < next_steps.size(); i++) {
+      StoredStep& s = p.steps[i];
+      next_steps[i].notes.assign(s.notes.begin(), s.notes.begin() + s.num_notes);
+      next_steps[i].num_locks = s.num_locks;
+      next_steps[i].locks = s.locks;
+      next_steps[i].mode = static_cast<StepMode>(s.mode % static_cast<uint8_t>(StepMode::Count));
+      next_steps[i].strum = s.strum;
+      next_steps[i].probability = s.probability;
+    }
+    next_ready = true;
+  }
+
+  // Returns whether it moved on a step
+  bool update(Player& player, Arp& arp, const Patch& base) {
+    prefetch();
+    if(!next || paused) return false;
     next = false;
 
+    // Copy so the pattern switch can't pull it out from under us
+    Step last{{}, StepMode::arp, 0, 100, steps[current_step].locks, steps[current_step].num_locks};
     next_step();
+    if(current_step == 0 && next_ready)
+      switch_pattern();
+    // Locks go in before the arp gets the notes so the step's first note
+    // plays with them. This is the main loop's update, so like the notes
+    // they land on the first block after the step's tick, not on its
+    // sample.
+    apply_locks(last, steps[current_step], player, arp, base);
 
-    //if(steps[current_step].mode == StepMode::chord)
-    //  player.play_chord(steps[current_step].notes);
-    //else
-    arp.set_notes(steps[current_step].notes);
+    Step& step = steps[current_step];
+    // A step that doesn't come up plays like an empty one, its locks
+    // still go in
+    if(!rng.chance(step.probability)) {
+      arp.clear();
+      return true;
+    }
+    switch(step.mode) {
+      case StepMode::arp:
+        arp.set_notes(step.notes);
+        break;
+      case StepMode::chord:
+        arp.clear();
+        player.play_chord(step.notes, step.strum);
+        break;
+      case StepMode::single:
+        {
+          arp.clear();
+          auto first = std::find_if(step.notes.begin(), step.notes.end(), [](uint8_t n) { return n != 127; });
+          if(first == step.notes.end()) {
+            player.play_rest();
+            break;
+          }
+          daisy::NoteOnEvent note{0, *first, 127};
+          player.play_note(note);
+        }
+        break;
+      default: break;
+    }
 
     //LogPrint("Seq::update - set %u / %u notes\n", notes.size(), steps[current_step].notes.size());
+    return true;
   }
 
   void process() {
@@ -101,6 +286,47 @@ class Seq {
       next = tick.Process();
   }
 
+  private:
+  // Walk both sorted lock lists, anything the last step locked that this
+  // one doesn't goes back to the patch value. Every control has one, the
+  // Part starts from control_defaults.
+  void apply_locks(const Step& last, const Step& step, Player& player, Arp& arp, const Patch& base) {
+    if(last.num_locks == 0 && step.num_locks == 0)
+      return;
+    uint8_t i = 0, j = 0;
+    while(i < last.num_locks || j < step.num_locks) {
+      if(j >= step.num_locks || (i < last.num_locks && last.locks[i].control < step.locks[j].control)) {
+        uint8_t control = last.locks[i++].control;
+        if(base[control] != Patch::unset)
+          control_desc(control).apply(player, arp, base[control]);
+        continue;
+      }
+      if(i < last.num_locks && last.locks[i].control == step.locks[j].control)
+        i++;
+      const ParamLock& lock = step.locks[j++];
+      control_desc(lock.control).apply(player, arp, lock.value);
+    }
+  }
+
+  void queue_slot(uint8_t slot) {
+    queued = slot;
+    next_ready = false;
+  }
+
+  void switch_pattern() {
+    std::swap(steps, next_steps);
+    pattern = queued;
+    next_ready = false;
+    queued = -1;
+    if(chain_len > 1) {
+      chain_pos = (chain_pos + 1) % chain_len;
+      queue_slot(chain[chain_pos]);
+    }
+    LogPrint("Seq::switch_pattern -> %u\n", pattern);
+  }
+
+  public:
+
  // void randomize() {
  //   for(int i = 0; i < nsteps; i++) {
  //     if(i < 8) {
@@ -0,0 +1,246 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+//#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+#define LogPrint(...)
+
+// Bulk dumps of patterns and patches over SysEx.
+//
+//   F0 7D 50 cmd target off_lo off_hi data... sum F7
+//
+// 7D is the non-commercial manufacturer id. A dump is split into packets
+// small enough for the libDaisy parser (SYSEX_BUFFER_LEN), off is where
+// the packet's bytes go in the whole dump. The data is packed 7 bytes to
+// 8, a byte with the top bits then the 7 bytes without them, and sum is
+// the low 7 bits of the sum of the packed bytes.
+//
+// The decoder takes a byte at a time and unpacks straight into where the
+// dump is going, nothing is buffered but the group it's in. No daisy in
+// here so a .syx file can be run through it on the host.
+
+namespace sysex {
+
+constexpr uint8_t start{0xF0};
+constexpr uint8_t end{0xF7};
+constexpr uint8_t manufacturer{0x7D};
+constexpr uint8_t device{0x50};
+
+enum class Cmd : uint8_t {
+  pattern = 0x01,         // target: bank slot
+  patch = 0x02,           // target: part
+  pattern_request = 0x41, // asks for a pattern dump back
+  patch_request = 0x42,
+};
+
+// Dump bytes per packet, 14 packed groups. With the header it comes to
+// 120 bytes between F0 and F7.
+constexpr size_t packet_bytes{98};
+constexpr size_t max_packet{packet_bytes / 7 * 8 + 9};
+
+// Packs size bytes into as many packets as it takes, send(bytes, n) is
+// called with each one
+template <typename Send>
+void encode(Cmd cmd, uint8_t target, const uint8_t* data, size_t size, Send send) {
+  uint8_t packet[max_packet];
+  for(size_t off = 0; off < size; off += packet_bytes) {
+    size_t n = 0;
+    packet[n++] = start;
+    packet[n++] = manufacturer;
+    packet[n++] = device;
+    packet[n++] = static_cast<uint8_t>(cmd);
+    packet[n++] = target & 0x7F;
+    packet[n++] = off & 0x7F;
+    packet[n++] = (off >> 7) & 0x7F;
+    size_t count = size - off < packet_bytes ? size - off : packet_bytes;
+    uint8_t sum = 0;
+    for(size_t g = 0; g < count; g += 7) {
+      size_t top = n++;
+      packet[top] = 0;
+      for(size_t i = 0; i < 7 && g + i < count; i++) {
+        uint8_t b = data[off + g + i];
+        packet[top] |= (b >> 7) << i;
+        packet[n] = b & 0x7F;
+        sum += packet[n++];
+      }
+      sum += packet[top];
+    }
+    packet[n++] = sum & 0x7F;
+    packet[n++] = end;
+    send(packet, n);
+  }
+}
+
+template <typename Send>
+void request(Cmd cmd, uint8_t target, Send send) {
+  uint8_t packet[]{start, manufacturer, device, static_cast<uint8_t>(cmd), static_cast<uint8_t>(target & 0x7F), 0, 0, 0, end};
+  send(packet, sizeof(packet));
+}
+
+enum class Result : uint8_t {
+  none,    // nothing finished yet
+  done,    // a whole dump is in, see cmd() and target()
+  request, // a dump was asked for
+  error,   // a bad packet, the dump it was part of is dropped
+};
+
+class Decoder {
+  enum class State : uint8_t { idle, header, data, skip };
+
+  // Where each kind of dump is unpacked to
+  uint8_t* pattern_dest{nullptr};
+  size_t pattern_size{0};
+  uint8_t* patch_dest{nullptr};
+  size_t patch_size{0};
+
+  State state{State::idle};
+  uint8_t header[6];
+  uint8_t header_len{0};
+
+  // The dump in progress
+  Cmd cur_cmd{};
+  uint8_t cur_target{0};
+  uint8_t* dest{nullptr};
+  size_t size{0};
+  size_t pos{0};
+  bool running{false};
+
+  // The packet in progress. The last byte before F7 is the sum so each
+  // byte is held back until the next one shows it isn't.
+  uint8_t sum{0};
+  uint8_t group{0}; // 0 is the top bits byte
+  uint8_t top{0};
+  uint8_t held{0};
+  bool holding{false};
+  bool overflow{false};
+
+  public:
+  void set_pattern_dest(uint8_t* data, size_t n) {
+    pattern_dest = data;
+    pattern_size = n;
+  }
+  void set_patch_dest(uint8_t* data, size_t n) {
+    patch_dest = data;
+    patch_size = n;
+  }
+
+  Cmd cmd() const { return cur_cmd; }
+  uint8_t target() const { return cur_target; }
+
+  Result feed(uint8_t b) {
+    // Realtime (clock etc.) can turn up anywhere
+    if(b >= 0xF8)
+      return Result::none;
+    if(b == start) {
+      bool dropped = state == State::data || state == State::header;
+      state = State::header;
+      header_len = 0;
+      return dropped ? fail() : Result::none;
+    }
+    if(b == end)
+      return finish();
+    // Any other status byte ends the packet without its F7
+    if(b & 0x80) {
+      bool dropped = state == State::data || state == State::header;
+      state = State::idle;
+      return dropped ? fail() : Result::none;
+    }
+
+    switch(state) {
+      case State::header:
+        header[header_len++] = b;
+        if(header_len == sizeof(header))
+          return begin();
+        // Someone else's SysEx
+        if((header_len == 1 && b != manufacturer) || (header_len == 2 && b != device))
+          state = State::skip;
+        return Result::none;
+      case State::data:
+        if(holding)
+          unpack(held);
+        held = b;
+        holding = true;
+        return Result::none;
+      default:
+        return Result::none;
+    }
+  }
+
+  private:
+  Result begin() {
+    Cmd c = static_cast<Cmd>(header[2]);
+    uint8_t t = header[3];
+    size_t off = header[4] | (header[5] << 7);
+    sum = 0;
+    group = 0;
+    holding = false;
+    overflow = false;
+    state = State::data;
+
+    if(c == Cmd::pattern_request || c == Cmd::patch_request)
+      return Result::none;
+    if(off == 0) {
+      cur_cmd = c;
+      cur_target = t;
+      pos = 0;
+      if(c == Cmd::pattern) {
+        dest = pattern_dest;
+        size = pattern_size;
+      }
+      else if(c == Cmd::patch) {
+        dest = patch_dest;
+        size = patch_size;
+      }
+      else
+        dest = nullptr;
+      running = dest != nullptr;
+    }
+    // Packets have to follow on from the last one
+    if(!running || c != cur_cmd || t != cur_target || off != pos) {
+      state = State::skip;
+      return fail();
+    }
+    return Result::none;
+  }
+
+  void unpack(uint8_t b) {
+    sum += b;
+    if(group == 0)
+      top = b;
+    else if(pos < size)
+      dest[pos++] = b | (((top >> (group - 1)) & 1) << 7);
+    else
+      overflow = true;
+    group = (group + 1) % 8;
+  }
+
+  Result finish() {
+    State was = state;
+    state = State::idle;
+    if(was != State::data)
+      return was == State::header ? fail() : Result::none;
+
+    Cmd c = static_cast<Cmd>(header[2]);
+    if(c == Cmd::pattern_request || c == Cmd::patch_request) {
+      cur_cmd = c;
+      cur_target = header[3];
+      return Result::request;
+    }
+    if(!holding || overflow || (sum & 0x7F) != held) {
+      LogPrint("sysex: bad packet at %u\n", pos);
+      return fail();
+    }
+    if(pos < size)
+      return Result::none;
+    running = false;
+    return Result::done;
+  }
+
+  Result fail() {
+    bool was_running = running;
+    running = false;
+    return was_running ? Result::error : Result::none;
+  }
+};
+
+} // namespace sysex
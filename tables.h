@@ -0,0 +1,187 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Lookup tables built by the compiler so the audio callback doesn't call
+// into libm. There's no constexpr std::sin / std::exp so the tables come
+// from the series below, worked in double and checked at compile time
+// against known values (the static_asserts at the end).
+
+namespace tables {
+
+constexpr double pi{3.14159265358979323846};
+constexpr double ln2{0.69314718055994530942};
+
+constexpr double ce_abs(double x) { return x < 0 ? -x : x; }
+
+// Taylor series after reducing to +-pi
+constexpr double ce_sin(double x) {
+  while(x > pi)
+    x -= 2 * pi;
+  while(x < -pi)
+    x += 2 * pi;
+  double term = x, sum = x;
+  for(int n = 1; n < 20; n++) {
+    term *= -x * x / ((2 * n) * (2 * n + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+// exp(r) for the remainder after taking out whole powers of 2
+constexpr double ce_exp2(double x) {
+  double scale = 1;
+  while(x >= 1) {
+    scale *= 2;
+    x -= 1;
+  }
+  while(x < 0) {
+    scale /= 2;
+    x += 1;
+  }
+  double r = x * ln2, term = 1, sum = 1;
+  for(int n = 1; n < 20; n++) {
+    term *= r / n;
+    sum += term;
+  }
+  return sum * scale;
+}
+
+constexpr double ce_tanh(double x) {
+  // tanh(x) = (e^2x - 1) / (e^2x + 1), e^2x = 2^(2x / ln2)
+  double e = ce_exp2(2 * x / ln2);
+  return (e - 1) / (e + 1);
+}
+
+// Each table has one guard point on the end for the interpolation
+template <size_t n, typename F>
+constexpr std::array<float, n + 1> make_table(F f) {
+  std::array<float, n + 1> t{};
+  for(size_t i = 0; i <= n; i++)
+    t[i] = static_cast<float>(f(static_cast<double>(i) / n));
+  return t;
+}
+
+// pos 0 - n for a table of n + 1. Float rounding can land pos on n
+// exactly (a phase a hair under 1 wraps to 1.0f), that's the guard point.
+constexpr float lerp_table(const float* t, size_t n, float pos) {
+  int32_t i = static_cast<int32_t>(pos);
+  if(i >= static_cast<int32_t>(n))
+    return t[n];
+  float frac = pos - i;
+  return t[i] + (t[i + 1] - t[i]) * frac;
+}
+
+// One cycle of sine
+constexpr size_t sine_size{1024};
+inline constexpr auto sine = make_table<sine_size>([](double x) { return ce_sin(2 * pi * x); });
+
+// phase 0 - 1
+constexpr float sin_cycle(float phase) {
+  phase -= static_cast<int32_t>(phase);
+  if(phase < 0)
+    phase += 1.0f;
+  return lerp_table(sine.data(), sine_size, phase * sine_size);
+}
+
+// 2^x over one octave
+constexpr size_t exp2_size{256};
+inline constexpr auto exp2_frac = make_table<exp2_size>([](double x) { return ce_exp2(x); });
+
+// Whole octaves, 2^-126 to 2^126. All exact in a float.
+constexpr int32_t exp2_octave_max{126};
+inline constexpr auto exp2_octaves = [] {
+  std::array<float, 2 * exp2_octave_max + 1> t{};
+  for(int32_t i = 0; i < static_cast<int32_t>(t.size()); i++)
+    t[i] = static_cast<float>(ce_exp2(i - exp2_octave_max));
+  return t;
+}();
+
+// 2^x for |x| < 126, clamped outside it
+constexpr float exp2(float x) {
+  int32_t octave = static_cast<int32_t>(x);
+  if(x < octave)
+    octave--;
+  if(octave < -exp2_octave_max)
+    return exp2_octaves[0];
+  if(octave >= exp2_octave_max)
+    return exp2_octaves[2 * exp2_octave_max];
+  float frac = x - octave;
+  return lerp_table(exp2_frac.data(), exp2_size, frac * exp2_size) * exp2_octaves[octave + exp2_octave_max];
+}
+
+// tanh over +-tanh_range, flat outside it
+constexpr size_t tanh_size{512};
+constexpr float tanh_range{4.0f};
+inline constexpr auto tanh_curve = make_table<tanh_size>([](double x) { return ce_tanh(tanh_range * (2 * x - 1)); });
+
+constexpr float tanh(float x) {
+  if(x >= tanh_range)
+    return tanh_curve[tanh_size];
+  if(x <= -tanh_range)
+    return tanh_curve[0];
+  return lerp_table(tanh_curve.data(), tanh_size, (x + tanh_range) * (tanh_size / (2 * tanh_range)));
+}
+
+// CC (0 - 127) to envelope segment seconds, as the envelope controls
+// have always mapped them
+inline constexpr auto cc_env_secs = [] {
+  std::array<float, 128> t{};
+  for(size_t i = 0; i < t.size(); i++)
+    t[i] = static_cast<float>(0.007 + i / 127.0);
+  return t;
+}();
+
+// CC to an exponential 200Hz - 16kHz, for the delay damping
+inline constexpr auto cc_damp_freq = [] {
+  std::array<float, 128> t{};
+  for(size_t i = 0; i < t.size(); i++)
+    t[i] = static_cast<float>(200 * ce_exp2(i / 127.0 * 6.321928094887362)); // log2(80)
+  return t;
+}();
+
+constexpr float cc_lookup(const std::array<float, 128>& t, float cc) {
+  if(cc <= 0)
+    return t[0];
+  if(cc >= 127)
+    return t[127];
+  return lerp_table(t.data(), t.size() - 1, cc);
+}
+
+// Accuracy. The tables against values from libm, and the interpolated
+// lookups against the series they were built from, between the points
+// where the error is worst.
+template <typename F, typename G>
+constexpr double max_error(F lookup, G exact, double from, double to, bool relative) {
+  double worst = 0;
+  for(int i = 0; i < 2000; i++) {
+    double x = from + (to - from) * (i + 0.5) / 2000;
+    double e = ce_abs(lookup(static_cast<float>(x)) - exact(x));
+    if(relative)
+      e /= exact(x);
+    if(e > worst)
+      worst = e;
+  }
+  return worst;
+}
+
+static_assert(ce_abs(sine[sine_size / 4] - 1.0) < 1e-7);
+static_assert(ce_abs(sine[sine_size / 8] - 0.70710678) < 1e-7);
+static_assert(ce_abs(sine[sine_size / 2]) < 1e-7);
+static_assert(ce_abs(exp2_frac[exp2_size] - 2.0) < 1e-7);
+static_assert(ce_abs(exp2_frac[exp2_size / 2] - 1.41421356) < 1e-7);
+static_assert(ce_abs(ce_exp2(-3.5) - 0.08838834765) < 1e-10);
+static_assert(ce_abs(tanh_curve[tanh_size / 2]) < 1e-7);
+static_assert(ce_abs(ce_tanh(1.0) - 0.76159415595) < 1e-10);
+static_assert(ce_abs(cc_damp_freq[127] - 16000.0) < 0.01);
+static_assert(max_error(sin_cycle, [](double x) { return ce_sin(2 * pi * x); }, 0, 1, false) < 1e-5);
+static_assert(max_error(exp2, ce_exp2, -8, 8, true) < 2e-6);
+static_assert(max_error(tanh, ce_tanh, -5, 5, false) < 1e-3);
+// Inputs that round onto the guard point, a read past it won't compile
+static_assert(exp2(-1e-9f) == 1.0f);
+static_assert(ce_abs(sin_cycle(-1e-9f)) < 1e-7);
+static_assert(tanh(3.9999998f) == tanh_curve[tanh_size]);
+static_assert(exp2(-200.0f) == exp2_octaves[0]);
+
+} // namespace tables
@@ -0,0 +1,71 @@
+#pragma once
+#include "daisy_pod.h"
+#include <cstdint>
+
+#include "player.h"
+
+//#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+#define LogPrint(...)
+
+// Keyboard transpose of the running pattern in play mode. The keys only
+// set an offset from root, the Player adds it when it triggers a note so
+// the Steps are never rewritten.
+enum class TransposeMode : uint8_t {
+  off,
+  momentary, // while the key is held, the last held key wins
+  latch,     // stays until the next key
+  legato,    // momentary, and sounding notes follow without retriggering
+  Count
+};
+
+class Transposer {
+  KeyTracker keys;
+  // Off until transpose_mode is pressed, out of edit mode the keys do
+  // nothing
+  TransposeMode mode{TransposeMode::off};
+  uint8_t root{60};
+  int8_t offset{0};
+
+  public:
+  // Both return whether the offset changed
+  bool press(daisy::NoteOnEvent& key) {
+    if(mode == TransposeMode::off)
+      return false;
+    keys.press(key);
+    return set(key.note - root);
+  }
+
+  bool release(daisy::NoteOnEvent& key) {
+    if(mode == TransposeMode::off)
+      return false;
+    keys.release(key);
+    if(mode == TransposeMode::latch)
+      return false;
+    return set(keys.keys.empty() ? 0 : keys.keys.back().note - root);
+  }
+
+  int8_t get() { return offset; }
+  bool legato() { return mode == TransposeMode::legato; }
+
+  void set_root(uint8_t note) { root = note; }
+
+  void next_mode() {
+    mode = static_cast<TransposeMode>((static_cast<uint8_t>(mode) + 1) % static_cast<uint8_t>(TransposeMode::Count));
+    keys.keys.clear();
+    offset = 0;
+  }
+
+  void mode_name(char* out) {
+    static constexpr const char* names[]{"Off", "Hold", "Latch", "Legato"};
+    std::sprintf(out, "%s", names[static_cast<uint8_t>(mode)]);
+  }
+
+  private:
+  bool set(int o) {
+    if(o == offset)
+      return false;
+    offset = o;
+    LogPrint("Transpose -> %i\n", offset);
+    return true;
+  }
+};
@@ -0,0 +1,146 @@
+#pragma once
+#include "daisy_pod.h"
+#include "daisysp.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+//#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+#define LogPrint(...)
+
+// Midi note to frequency, looked up from a table so note on doesn't pay
+// for a powf. The table is only rebuilt when the scale or root changes.
+//
+// Scales are Scala .scl text: '!' comment lines, a description line, the
+// number of degrees, then one pitch per line, either cents (has a '.')
+// or a ratio (3/2 or 2). The last pitch is the period, usually 2/1.
+// The root note keeps its 12-TET pitch and the scale is laid out from it.
+
+// Built in scales, more can come from load_scala()
+constexpr std::array<const char*, 5> tuning_presets{
+  "! 12tet.scl\n12-TET\n12\n100.\n200.\n300.\n400.\n500.\n600.\n700.\n800.\n900.\n1000.\n1100.\n2/1\n",
+  "! just.scl\nJust 5-limit\n12\n16/15\n9/8\n6/5\n5/4\n4/3\n45/32\n3/2\n8/5\n5/3\n9/5\n15/8\n2/1\n",
+  "! pyth.scl\nPythagorean\n12\n256/243\n9/8\n32/27\n81/64\n4/3\n729/512\n3/2\n128/81\n27/16\n16/9\n243/128\n2/1\n",
+  "! meantone.scl\nQtr-comma mean\n12\n76.049\n193.157\n310.265\n386.314\n503.422\n579.471\n696.579\n772.627\n889.735\n1006.843\n1082.892\n2/1\n",
+  "! 19edo.scl\n19-EDO\n19\n63.158\n126.316\n189.474\n252.632\n315.789\n378.947\n442.105\n505.263\n568.421\n631.579\n694.737\n757.895\n821.053\n884.211\n947.368\n1010.526\n1073.684\n1136.842\n2/1\n",
+};
+
+class Tuning {
+  public:
+  static constexpr size_t max_degrees{128};
+
+  private:
+  // Two tables so a rebuild never leaves a half written one in use
+  std::array<std::array<float, 128>, 2> tables{};
+  uint8_t live{0};
+
+  std::array<float, max_degrees> cents{}; // degree 1 .. n, the last is the period
+  uint8_t degrees{0};
+  uint8_t root{60};
+  char name[17]{0,};
+
+  public:
+  Tuning() { load_scala(tuning_presets[0]); }
+
+  float freq(uint8_t note) const { return tables[live][note & 127]; }
+
+  uint8_t get_root() { return root; }
+  void set_root(uint8_t note) {
+    root = note & 127;
+    rebuild();
+  }
+
+  const char* get_name() { return name; }
+
+  // Returns false and leaves the tuning alone if the text doesn't parse
+  bool load_scala(const char* text) {
+    std::array<float, max_degrees> new_cents{};
+    char desc[17]{0,};
+    int count = -1;
+    int n = 0;
+    bool have_desc = false;
+
+    const char* line = text;
+    while(*line && (count < 0 || n < count)) {
+      const char* end = std::strchr(line, '\n');
+      if(!end)
+        end = line + std::strlen(line);
+      if(*line != '!') {
+        if(!have_desc) {
+          size_t len = std::min<size_t>(end - line, sizeof(desc) - 1);
+          if(len > 0 && line[len - 1] == '\r')
+            len--;
+          std::memcpy(desc, line, len);
+          have_desc = true;
+        }
+        else if(count < 0) {
+          count = std::atoi(line);
+          if(count <= 0 || count > static_cast<int>(max_degrees))
+            return false;
+        }
+        else {
+          float c;
+          if(!parse_pitch(line, end, c))
+            return false;
+          new_cents[n++] = c;
+        }
+      }
+      line = *end ? end + 1 : end;
+    }
+    if(count <= 0 || n != count)
+      return false;
+
+    cents = new_cents;
+    degrees = count;
+    std::memcpy(name, desc, sizeof(name));
+    rebuild();
+    LogPrint("Tuning: %s, %u degrees\n", name, degrees);
+    return true;
+  }
+
+  private:
+  static bool parse_pitch(const char* p, const char* end, float& out) {
+    while(p < end && (*p == ' ' || *p == '\t'))
+      p++;
+    if(p >= end)
+      return false;
+    // Anything after the pitch is a comment
+    const char* token_end = p;
+    while(token_end < end && *token_end != ' ' && *token_end != '\t' && *token_end != '\r')
+      token_end++;
+    const char* dot = static_cast<const char*>(std::memchr(p, '.', token_end - p));
+    if(dot) {
+      out = std::strtof(p, nullptr);
+      return true;
+    }
+    char* next;
+    long num = std::strtol(p, &next, 10);
+    long den = 1;
+    if(next < end && *next == '/')
+      den = std::strtol(next + 1, nullptr, 10);
+    if(num <= 0 || den <= 0)
+      return false;
+    out = 1200.0f * log2f(static_cast<float>(num) / static_cast<float>(den));
+    return true;
+  }
+
+  void rebuild() {
+    auto& table = tables[live ^ 1];
+    float period = cents[degrees - 1];
+    float root_freq = daisysp::mtof(root);
+    for(int note = 0; note < 128; note++) {
+      int steps = note - root;
+      int octave = steps >= 0 ? steps / degrees : -((degrees - 1 - steps) / degrees);
+      int degree = steps - octave * degrees;
+      float c = octave * period + (degree > 0 ? cents[degree - 1] : 0.0f);
+      table[note] = root_freq * exp2f(c / 1200.0f);
+    }
+    live ^= 1;
+  }
+};
+
+// Shared by every voice
+static Tuning tuning;
@@ -0,0 +1,112 @@
+#pragma once
+#include "daisy_pod.h"
+#include "daisysp.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include "placement.h"
+#include "tables.h"
+
+//#define LogPrint(...) daisy::DaisySeed::Print(__VA_ARGS__)
+#define LogPrint(...)
+
+// A stack of detuned saws spread across the stereo field, the supersaw.
+// The whole stack is rendered a block at a time with all the phases side
+// by side, so the per oscillator cost is just the phase step and the
+// polyblep instead of a full daisysp::Oscillator each.
+class Unison {
+  public:
+  static constexpr size_t max_voices{8};
+  static constexpr size_t max_block{64};
+
+  private:
+  float samplerate{48000};
+  size_t count{1};
+  float spread{0.2}; // semitones either side of the centre
+  float width{1};    // 0 mono, 1 the outer saws hard left and right
+  float freq{0};
+
+  std::array<float, max_voices> phase{};
+  std::array<float, max_voices> inc{};
+  std::array<float, max_voices> ratio{};
+  std::array<float, max_voices> gain_l{};
+  std::array<float, max_voices> gain_r{};
+
+  public:
+  void Init(float sr) {
+    samplerate = sr;
+    layout();
+  }
+
+  void set_count(size_t n) {
+    count = std::clamp<size_t>(n, 1, max_voices);
+    layout();
+  }
+  size_t get_count() { return count; }
+  void set_spread(float semitones) {
+    spread = semitones;
+    layout();
+  }
+  void set_width(float w) {
+    width = w;
+    layout();
+  }
+
+  void set_freq(float f) {
+    freq = f;
+    for(size_t k = 0; k < count; k++)
+      inc[k] = freq * ratio[k] / samplerate;
+  }
+
+  // Fixed starting phases, spread out but the same every time so
+  // recorded sessions replay the same
+  void reset() {
+    for(size_t k = 0; k < count; k++)
+      phase[k] = k * 0.618034f - static_cast<int>(k * 0.618034f);
+  }
+
+  // Adds the stack into l / r
+  HOT_CODE void process(float* l, float* r, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+      float sl = 0, sr = 0;
+      for(size_t k = 0; k < count; k++) {
+        float p = phase[k] + inc[k];
+        p -= static_cast<int>(p);
+        phase[k] = p;
+        float s = 2.0f * p - 1.0f - polyblep(p, inc[k]);
+        sl += s * gain_l[k];
+        sr += s * gain_r[k];
+      }
+      l[i] += sl;
+      r[i] += sr;
+    }
+  }
+
+  private:
+  static float polyblep(float t, float dt) {
+    if(t < dt) {
+      t /= dt;
+      return t + t - t * t - 1.0f;
+    }
+    if(t > 1.0f - dt) {
+      t = (t - 1.0f) / dt;
+      return t * t + t + t + 1.0f;
+    }
+    return 0.0f;
+  }
+
+  // Detune and pan for each saw, only when the settings change
+  void layout() {
+    float norm = 1.0f / sqrtf(static_cast<float>(count));
+    for(size_t k = 0; k < count; k++) {
+      float pos = count > 1 ? 2.0f * k / (count - 1) - 1.0f : 0.0f;
+      ratio[k] = tables::exp2(pos * spread / 12.0f);
+      float pan = pos * width;
+      gain_l[k] = std::min(1.0f, 1.0f - pan) * norm;
+      gain_r[k] = std::min(1.0f, 1.0f + pan) * norm;
+    }
+    set_freq(freq);
+  }
+};